@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "freezer.h"
 #include "fdisk_hal.h"
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
+#include "fdisk_fat32.h"
+#include "fdisk_fatmap.h"
 #include "ascii.h"
 
 unsigned long root_dir_sector = 0;
@@ -14,21 +17,13 @@ unsigned char sectors_per_cluster = 0;
 unsigned char fat_copies = 0;
 unsigned long sectors_per_fat = 0;
 unsigned long root_dir_cluster = 0;
+unsigned long fsinfo_sector = 0;
+// Clusters 2 to cluster_count - 1 exist
+unsigned long cluster_count = 0;
 
-void mega65_serial_monitor_write(char* s)
-{
-  while (*s) {
-    // There is almost certainly a better way to do this, but it works.
-    POKE(0x380, *s);
-    __asm__("lda $0380");
-
-    // Use CLC in the spare instruction slot, in case assembler tries to
-    // optimise a NOP away.
-    __asm__("sta $d643");
-    __asm__("clc");
-    s++;
-  }
-}
+// Hints from the FSInfo sector
+unsigned long fsinfo_free_clusters = FSINFO_UNKNOWN;
+unsigned long fsinfo_next_free = FSINFO_UNKNOWN;
 
 char hexchar2(unsigned char v)
 {
@@ -73,7 +68,7 @@ void parse_partition_entry(const char i)
   char ehead = sector_buffer[offset + 5];
   char esector = sector_buffer[offset + 6] & 0x1f;
   int ecylinder = ((sector_buffer[offset + 6] << 2) & 0x300) + sector_buffer[offset + 7];
-  uint32_t lba_start, lba_size;
+  uint32_t lba_start, lba_size, total_sectors;
 
   for (j = 0; j < 4; j++)
     ((char*)&lba_start)[j] = sector_buffer[offset + 8 + j];
@@ -99,6 +94,15 @@ void parse_partition_entry(const char i)
     // cluster of root directort @ $02c-$02f
     for (j = 0; j < 4; j++)
       ((char*)&root_dir_cluster)[j] = sector_buffer[0x2c + j];
+    // total sectors @ $020-$023
+    for (j = 0; j < 4; j++)
+      ((char*)&total_sectors)[j] = sector_buffer[0x20 + j];
+    // FSInfo sector @ $030-$031 (0 or $FFFF if there is none)
+    fsinfo_sector = sector_buffer[0x30] + (sector_buffer[0x31] << 8L);
+    if (fsinfo_sector == 0xffff)
+      fsinfo_sector = 0;
+    if (fsinfo_sector)
+      fsinfo_sector += lba_start;
     // $55 $AA signature @ $1fe-$1ff
 
     // FATs begin at partition + reserved sectors
@@ -106,6 +110,9 @@ void parse_partition_entry(const char i)
     root_dir_sector = lba_start + reserved_sectors + sectors_per_fat * fat_copies;
     fat1_sector = lba_start + reserved_sectors;
     fat2_sector = lba_start + reserved_sectors + sectors_per_fat;
+    cluster_count = (lba_start + total_sectors - root_dir_sector) / sectors_per_cluster + 2;
+    if (cluster_count > sectors_per_fat * 128)
+      cluster_count = sectors_per_fat * 128;
   }
 
 #if 0
@@ -211,6 +218,48 @@ void getrtc(struct m65_tm* tm)
   }
 }
 
+unsigned char fsinfo_valid(void)
+{
+  // Is the FSInfo sector in sector_buffer?
+  return *(unsigned long*)&sector_buffer[0x000] == 0x41615252UL
+      && *(unsigned long*)&sector_buffer[0x1e4] == 0x61417272UL;
+}
+
+void fat32_read_fsinfo(void)
+{
+  // Pick up the free cluster count and next free cluster hints.
+  // Either can be FSINFO_UNKNOWN, and neither is to be trusted blindly.
+  fsinfo_free_clusters = FSINFO_UNKNOWN;
+  fsinfo_next_free = FSINFO_UNKNOWN;
+  if (!fsinfo_sector)
+    return;
+  sdcard_readsector(fsinfo_sector);
+  if (!fsinfo_valid())
+    return;
+  fsinfo_free_clusters = *(unsigned long*)&sector_buffer[0x1e8];
+  fsinfo_next_free = *(unsigned long*)&sector_buffer[0x1ec];
+  if (fsinfo_free_clusters >= cluster_count)
+    fsinfo_free_clusters = FSINFO_UNKNOWN;
+}
+
+void fat32_update_fsinfo(unsigned long next_free, long allocated)
+{
+  // Account for newly allocated (or with allocated < 0, freed) clusters in
+  // the FSInfo hints
+  if (fsinfo_free_clusters != FSINFO_UNKNOWN)
+    fsinfo_free_clusters = (allocated <= (long)fsinfo_free_clusters) ? fsinfo_free_clusters - allocated : FSINFO_UNKNOWN;
+  fsinfo_next_free = next_free;
+
+  if (!fsinfo_sector)
+    return;
+  sdcard_readsector(fsinfo_sector);
+  if (!fsinfo_valid())
+    return;
+  *(unsigned long*)&sector_buffer[0x1e8] = fsinfo_free_clusters;
+  *(unsigned long*)&sector_buffer[0x1ec] = fsinfo_next_free;
+  sdcard_writesector(fsinfo_sector, 0);
+}
+
 unsigned char fat32_open_file_system(void)
 {
   unsigned char i;
@@ -222,193 +271,613 @@ unsigned char fat32_open_file_system(void)
     for (i = 0; i < 4; i++) {
       parse_partition_entry(i);
     }
+    fat32_read_fsinfo();
+  }
+  return 0;
+}
+
+/*
+  FAT sector cache.
+
+  Recently used FAT sectors are kept in attic RAM, so that walking a chain
+  doesn't read the same FAT sector again for every cluster, and doesn't
+  disturb whatever the caller has in sector_buffer. Changes are made in the
+  cache, and only written out, to both FATs, by fat32_sync() (or when a
+  changed sector has to make way for another one). Changed sectors that
+  follow on from each other are written in one go.
+*/
+#define FATCACHE_SLOTS 16
+#define FATCACHE_SCRATCH_ADDRESS (ATTIC_FATCACHE_ADDRESS + 0x0000)
+#define fatcache_address(slot) (ATTIC_FATCACHE_ADDRESS + 0x0200 + ((long)(slot) << 9))
+
+// Age 0 = slot unused
+unsigned long fatcache_sector[FATCACHE_SLOTS];
+unsigned short fatcache_age[FATCACHE_SLOTS];
+unsigned char fatcache_dirty[FATCACHE_SLOTS];
+unsigned short fatcache_clock = 0;
+
+unsigned char fatcache_find(unsigned long fat_sector_num)
+{
+  unsigned char slot;
+
+  for (slot = 0; slot < FATCACHE_SLOTS; slot++)
+    if (fatcache_age[slot] && fatcache_sector[slot] == fat_sector_num)
+      break;
+  return slot;
+}
+
+void fatcache_write_run(unsigned char first)
+{
+  // Write the changed sector in slot <first>, and any changed ones that
+  // follow directly after it, to both FATs
+  unsigned long fat_sector_num = fatcache_sector[first], base;
+  unsigned char fat, slot, count;
+
+  for (fat = 0; fat < 2; fat++) {
+    base = (fat ? fat2_sector : fat1_sector) + fat_sector_num;
+    for (count = 0; (slot = fatcache_find(fat_sector_num + count)) < FATCACHE_SLOTS && fatcache_dirty[slot]; count++) {
+      lcopy(fatcache_address(slot), (long)sector_buffer, 512);
+#ifdef USE_MULTIBLOCK_WRITE
+      if (!count)
+        sdcard_writesector(base, 1);
+      else
+        sdcard_writenextsector();
+#else
+      sdcard_writesector(base + count, 0);
+#endif
+    }
+#ifdef USE_MULTIBLOCK_WRITE
+    // Close multi-sector write job
+    sdcard_writemultidone();
+#endif
+  }
+
+  while (count--)
+    fatcache_dirty[fatcache_find(fat_sector_num + count)] = 0;
+}
+
+void fat32_sync(void)
+{
+  // Write out all changed FAT sectors, lowest first, so that runs of them
+  // can be written together
+  unsigned char slot, first;
+
+  lcopy((long)sector_buffer, FATCACHE_SCRATCH_ADDRESS, 512);
+  for (;;) {
+    first = FATCACHE_SLOTS;
+    for (slot = 0; slot < FATCACHE_SLOTS; slot++)
+      if (fatcache_dirty[slot] && (first == FATCACHE_SLOTS || fatcache_sector[slot] < fatcache_sector[first]))
+        first = slot;
+    if (first == FATCACHE_SLOTS)
+      break;
+    fatcache_write_run(first);
+  }
+  lcopy(FATCACHE_SCRATCH_ADDRESS, (long)sector_buffer, 512);
+}
+
+long fatcache_entry_address(unsigned long cluster)
+{
+  // Where the FAT entry for a cluster is in the cache, reading its FAT
+  // sector in first, if need be
+  unsigned long fat_sector_num = cluster >> 7;
+  unsigned char slot, victim = 0;
+
+  slot = fatcache_find(fat_sector_num);
+  if (slot == FATCACHE_SLOTS) {
+    // Unused slot, else the least recently used one
+    for (slot = 1; slot < FATCACHE_SLOTS; slot++)
+      if (fatcache_age[slot] < fatcache_age[victim])
+        victim = slot;
+    slot = victim;
+
+    lcopy((long)sector_buffer, FATCACHE_SCRATCH_ADDRESS, 512);
+    if (fatcache_dirty[slot])
+      fatcache_write_run(slot);
+    sdcard_readsector(fat1_sector + fat_sector_num);
+    lcopy((long)sector_buffer, fatcache_address(slot), 512);
+    lcopy(FATCACHE_SCRATCH_ADDRESS, (long)sector_buffer, 512);
+    fatcache_sector[slot] = fat_sector_num;
+  }
+
+  if (!++fatcache_clock) {
+    // Wrapped around, so start the ages again
+    for (victim = 0; victim < FATCACHE_SLOTS; victim++)
+      if (fatcache_age[victim])
+        fatcache_age[victim] = 1;
+    fatcache_clock = 2;
   }
+  fatcache_age[slot] = fatcache_clock;
+  return fatcache_address(slot) + ((cluster & 127) << 2);
+}
+
+unsigned long fat32_current_dir_cluster(void)
+{
+  // The hypervisor's current directory. In a sub-directory, the first
+  // entry is "." which points to the directory itself.
+  unsigned char dir;
+  struct m65_dirent* dirent;
+  unsigned long cluster = root_dir_cluster;
+
+  closeall();
+  dir = opendir();
+  dirent = readdir(dir);
+  if (dirent && ((unsigned short)dirent != 0xffffU) && !strcmp(dirent->d_name, "."))
+    cluster = dirent->d_ino;
+  closedir(dir);
+  return cluster;
 }
 
 unsigned long fat32_follow_cluster(unsigned long cluster)
 {
   unsigned long r;
   // Read out the cluster number from the FAT
-  sdcard_readsector(fat1_sector + (cluster / 128));
-  r = *(unsigned long*)&sector_buffer[(cluster & 127) << 2];
+  lcopy(fatcache_entry_address(cluster), (long)&r, 4);
   return r;
 }
 
-unsigned long fat32_allocate_cluster(unsigned long cluster)
+void fat32_set_cluster(unsigned long cluster, unsigned long value)
 {
-  unsigned long new_cluster;
-  unsigned long fat_sector_num;
+  // Change a FAT entry, in the cache for now
+  long address = fatcache_entry_address(cluster);
+  unsigned long r;
+
+  lcopy(address, (long)&r, 4);
+  if (r != value) {
+    lcopy((long)&value, address, 4);
+    fatcache_dirty[fatcache_find(cluster >> 7)] = 1;
+  }
+}
+
+unsigned long fat32_find_contiguous(unsigned long clusters)
+{
+  // Find a run of at least <clusters> free clusters, from the free space
+  // map if we can. Else read the FAT, starting from the next free cluster
+  // hint, and then trying the part of the FAT before it.
+  // Runs can begin and end anywhere in a FAT sector, but whole FAT sectors
+  // of free clusters are skipped over without looking at each one.
+  // Returns the first cluster of the run, or 0 if there is none.
+  unsigned long cluster, first, end, run_start = 0, run;
   unsigned short i;
+  unsigned char pass;
+
+  if (fatmap_open())
+    return fatmap_find(clusters);
+  fat32_sync();
+
+  first = fsinfo_next_free;
+  if (first < 2 || first >= cluster_count)
+    first = 2;
+  end = cluster_count;
+
+  for (pass = 0; pass < 2; pass++) {
+    run = 0;
+    for (cluster = first; cluster < end; cluster++) {
+      if (!(cluster & 127) || cluster == first) {
+        // This can take a while if the disk is full, so show the user that
+        // something is happening.
+        POKE(0xD020, PEEK(0xD020) + 1);
+        sdcard_readsector(fat1_sector + (cluster >> 7));
+
+        if (!(cluster & 127) && cluster + 128 <= end) {
+          for (i = 0; i < 512; i++)
+            if (sector_buffer[i])
+              break;
+          if (i == 512) {
+            if (!run)
+              run_start = cluster;
+            run += 128;
+            if (run >= clusters)
+              return run_start;
+            cluster += 127;
+            continue;
+          }
+        }
+      }
 
-  // Find free cluster
-  for (fat_sector_num = 0; fat_sector_num < (fat2_sector - fat1_sector); fat_sector_num++) {
-    sdcard_readsector(fat1_sector + fat_sector_num);
-    for (i = 0; i < 512; i += 4) {
-      if (*(unsigned long*)&sector_buffer[i] == 0)
-        break;
+      if (*(unsigned long*)&sector_buffer[(cluster & 127) << 2] & 0x0fffffffUL)
+        run = 0;
+      else {
+        if (!run)
+          run_start = cluster;
+        if (++run >= clusters)
+          return run_start;
+      }
     }
-    if (i < 512) {
-      // Found new free cluster, so place end-of-chain marker on it
-      new_cluster = fat_sector_num * 128 + (i >> 2);
-      *(unsigned long*)&sector_buffer[i] = 0x0fffffff;
-      sdcard_writesector(fat1_sector + fat_sector_num, 0);
-      sdcard_writesector(fat2_sector + fat_sector_num, 0);
-
-      // chain old cluster to new cluster
-      fat_sector_num = cluster / 128;
-      sdcard_readsector(fat1_sector + fat_sector_num);
-      *(unsigned long*)&sector_buffer[(cluster & 127) << 2] = new_cluster;
-      sdcard_writesector(fat1_sector + fat_sector_num, 0);
-      sdcard_writesector(fat2_sector + fat_sector_num, 0);
-      return new_cluster;
+
+    // Then from the start, up to where a run would have to reach the hint
+    if (first == 2)
+      break;
+    end = first + clusters;
+    if (end > cluster_count)
+      end = cluster_count;
+    first = 2;
+  }
+
+  return 0;
+}
+
+void fat32_write_chain(unsigned long start_cluster, unsigned long clusters)
+{
+  // Link clusters start_cluster to start_cluster + clusters - 1 into a
+  // chain (in the FAT cache, until the next fat32_sync())
+  unsigned long cluster, end = start_cluster + clusters;
+
+  fatmap_allocate(start_cluster, clusters);
+  for (cluster = start_cluster; cluster < end; cluster++)
+    fat32_set_cluster(cluster, (cluster + 1 == end) ? 0x0ffffff8UL : cluster + 1);
+}
+
+unsigned long fat32_free_chain(unsigned long cluster)
+{
+  // Mark a cluster chain as free again (in the FAT cache, until the next
+  // fat32_sync()). Returns the number of clusters freed.
+  unsigned long next, run_start = cluster, count = 0;
+
+  while (cluster >= 2 && cluster < FAT32_END_OF_CHAIN && count < cluster_count) {
+    next = fat32_follow_cluster(cluster) & 0x0fffffffUL;
+    fat32_set_cluster(cluster, 0);
+    count++;
+    // Give the free space map whole runs, rather than a cluster at a time
+    if (next != cluster + 1) {
+      fatmap_free(run_start, cluster + 1 - run_start);
+      run_start = next;
     }
+    cluster = next;
+  }
+
+  fat32_update_fsinfo(fsinfo_next_free, -(long)count);
+  return count;
+}
+
+unsigned long fat32_allocate_cluster(unsigned long cluster)
+{
+  unsigned long new_cluster;
+
+  // Find free cluster, and place end-of-chain marker on it
+  new_cluster = fat32_find_contiguous(1);
+  if (!new_cluster)
+    return 0;
+  fat32_write_chain(new_cluster, 1);
+
+  // chain old cluster to new cluster
+  fat32_set_cluster(cluster, new_cluster);
+
+  fat32_update_fsinfo(new_cluster + 1, 1);
+  return new_cluster;
+}
+
+// Clusters set aside by fat32_reserve(), that fat32_create_contiguous_file()
+// hands out in order before looking anywhere else
+static unsigned long reserved_cluster = 0, reserved_clusters = 0;
+
+unsigned long fat32_reserve(unsigned long clusters)
+{
+  // Set aside one run of free clusters for a batch of files, so that they
+  // end up next to each other. This is only done with the free space map,
+  // and taking the run out of the map is what keeps anything else (like a
+  // new directory cluster) from being given it in the meantime.
+  // Returns the first cluster of the run, or 0 if there is none.
+  fat32_release();
+  if (!fatmap_open())
+    return 0;
+  reserved_cluster = fatmap_find(clusters);
+  if (reserved_cluster) {
+    reserved_clusters = clusters;
+    fatmap_allocate(reserved_cluster, clusters);
+  }
+  return reserved_cluster;
+}
+
+void fat32_release(void)
+{
+  // Put back whatever is left of the reservation
+  if (reserved_clusters)
+    fatmap_free(reserved_cluster, reserved_clusters);
+  reserved_clusters = 0;
+}
+
+/*
+  Directory index.
+
+  To create a file, we need to know whether its name is already taken, and
+  where there is a free slot for its entry. fat32_index_directory() finds
+  out both in one pass over the directory, comparing raw 8.3 names, and
+  keeps the names in a hash table in attic RAM, together with the deleted
+  entries (which are reused first) and where the directory ends. So creating
+  another file in the same directory doesn't have to read it again.
+*/
+#define DIRINDEX_BUCKETS 8192
+#define DIRINDEX_MAX_NAMES 6144
+#define DIRINDEX_FREE_SLOTS 16
+#define dirindex_bucket_address(b) (ATTIC_DIRINDEX_ADDRESS + ((long)(b) << 4))
+
+// Start cluster of the indexed directory, or 0 if none
+unsigned long dirindex_cluster = 0;
+unsigned short dirindex_names;
+unsigned char dirindex_free_count;
+unsigned long dirindex_free_sector[DIRINDEX_FREE_SLOTS];
+unsigned short dirindex_free_offset[DIRINDEX_FREE_SLOTS];
+// The end of directory marker, or dirindex_end_sector = 0 if the last cluster is full
+unsigned long dirindex_last_cluster, dirindex_end_sector;
+unsigned short dirindex_end_offset;
+
+void fat32_raw_name(char* name, unsigned char* raw)
+{
+  // "NAME.EXT" to the 11 characters of a directory entry
+  unsigned char i;
+
+  memset(raw, ' ', 11);
+  for (i = 0; i < 8 && *name && *name != '.'; i++)
+    raw[i] = *name++;
+  while (*name && *name != '.')
+    name++;
+  if (*name)
+    name++;
+  for (i = 8; i < 11 && *name; i++)
+    raw[i] = *name++;
+}
+
+unsigned char dirindex_probe(unsigned char* raw, unsigned char insert)
+{
+  // Is the name in the hash table? If not, and insert is set, put it there.
+  // Buckets are a used flag, then the name.
+  unsigned char bucket[12];
+  unsigned short b = 0;
+  unsigned char i;
+
+  for (i = 0; i < 11; i++)
+    b = (b << 3) + (b >> 13) + raw[i];
+  b &= DIRINDEX_BUCKETS - 1;
+
+  for (;;) {
+    lcopy(dirindex_bucket_address(b), (long)bucket, 12);
+    if (!bucket[0])
+      break;
+    if (!memcmp(&bucket[1], raw, 11))
+      return 1;
+    b = (b + 1) & (DIRINDEX_BUCKETS - 1);
   }
 
+  if (insert) {
+    if (dirindex_names == DIRINDEX_MAX_NAMES) {
+      // Too full to be of use: index the directory again next time
+      dirindex_cluster = 0;
+      return 0;
+    }
+    bucket[0] = 1;
+    memcpy(&bucket[1], raw, 11);
+    lcopy((long)bucket, dirindex_bucket_address(b), 12);
+    dirindex_names++;
+  }
   return 0;
 }
 
+unsigned char fat32_index_directory(unsigned long dir_cluster, unsigned char* raw)
+{
+  // Index the directory, returning 1 if it contains the raw name
+  unsigned char sn, found = 0;
+  unsigned short offset;
+  unsigned char* e;
+  unsigned long sector;
+
+  lfill(ATTIC_DIRINDEX_ADDRESS, 0, 0x8000);
+  lfill(ATTIC_DIRINDEX_ADDRESS + 0x8000, 0, 0x8000);
+  lfill(ATTIC_DIRINDEX_ADDRESS + 0x10000, 0, 0x8000);
+  lfill(ATTIC_DIRINDEX_ADDRESS + 0x18000, 0, 0x8000);
+  dirindex_cluster = dir_cluster;
+  dirindex_names = 0;
+  dirindex_free_count = 0;
+  dirindex_end_sector = 0;
+
+  while (dir_cluster >= 2 && dir_cluster < FAT32_END_OF_CHAIN) {
+    dirindex_last_cluster = dir_cluster;
+    for (sn = 0; sn < sectors_per_cluster; sn++) {
+      sector = fat32_cluster_sector(dir_cluster) + sn;
+      sdcard_readsector(sector);
+      for (offset = 0; offset < 512; offset += 32) {
+        e = &sector_buffer[offset];
+        if (!e[0]) {
+          dirindex_end_sector = sector;
+          dirindex_end_offset = offset;
+          return found;
+        }
+        if (e[0] == 0xe5) {
+          if (dirindex_free_count < DIRINDEX_FREE_SLOTS) {
+            dirindex_free_sector[dirindex_free_count] = sector;
+            dirindex_free_offset[dirindex_free_count++] = offset;
+          }
+        }
+        // Skip long name parts and the volume label
+        else if (e[11] != 0x0f && !(e[11] & 0x08)) {
+          if (!memcmp(e, raw, 11))
+            found = 1;
+          dirindex_probe(e, 1);
+        }
+      }
+    }
+    dir_cluster = fat32_follow_cluster(dir_cluster) & 0x0fffffffUL;
+  }
+  return found;
+}
+
+unsigned char* fat32_find_entry(unsigned long dir_cluster, char* name)
+{
+  // Directory entry of a file (in sector_buffer), or NULL if it isn't there
+  unsigned char raw[11], sn;
+  unsigned short offset;
+  unsigned char* e;
+
+  fat32_raw_name(name, raw);
+  while (dir_cluster >= 2 && dir_cluster < FAT32_END_OF_CHAIN) {
+    for (sn = 0; sn < sectors_per_cluster; sn++) {
+      sdcard_readsector(fat32_cluster_sector(dir_cluster) + sn);
+      for (offset = 0; offset < 512; offset += 32) {
+        e = &sector_buffer[offset];
+        if (!e[0])
+          return NULL;
+        if (e[0] != 0xe5 && !(e[11] & 0x18) && !memcmp(e, raw, 11))
+          return e;
+      }
+    }
+    dir_cluster = fat32_follow_cluster(dir_cluster) & 0x0fffffffUL;
+  }
+  return NULL;
+}
+
+unsigned long fat32_find_file(unsigned long dir_cluster, char* name, unsigned long* size)
+{
+  // Start cluster and size of a file in a directory, or 0 if it isn't there
+  unsigned char* e = fat32_find_entry(dir_cluster, name);
+
+  if (!e)
+    return 0;
+  *size = *(unsigned long*)&e[0x1c];
+  return e[0x1a] | ((unsigned long)e[0x1b] << 8) | ((unsigned long)e[0x14] << 16) | ((unsigned long)e[0x15] << 24);
+}
+
+unsigned char fat32_read_chain(unsigned long cluster, long address, unsigned short sectors)
+{
+  // Read the first <sectors> sectors of a file into far memory, following
+  // its cluster chain. Returns 0 if the chain is too short.
+  unsigned char sn = 0;
+
+  while (sectors--) {
+    if (sn == sectors_per_cluster) {
+      cluster = fat32_follow_cluster(cluster) & 0x0fffffffUL;
+      if (cluster < 2 || cluster >= FAT32_END_OF_CHAIN)
+        return 0;
+      sn = 0;
+    }
+    sdcard_readsector(fat32_cluster_sector(cluster) + sn++);
+    lcopy((long)sector_buffer, address, 512);
+    address += 512;
+  }
+  return 1;
+}
+
+void fat32_write_sectors(unsigned long sector, long address, unsigned char count)
+{
+  // Write <count> sectors from far memory to consecutive sectors on the SD
+  // card, e.g., into a contiguous file, as one multi-sector job if we can
+  unsigned char i;
+
+  for (i = 0; i < count; i++) {
+    lcopy(address + ((long)i << 9), (long)sector_buffer, 512);
+#ifdef USE_MULTIBLOCK_WRITE
+    if (!i)
+      sdcard_writesector(sector, 1);
+    else
+      sdcard_writenextsector();
+#else
+    sdcard_writesector(sector + i, 0);
+#endif
+  }
+#ifdef USE_MULTIBLOCK_WRITE
+  // Close multi-sector write job
+  sdcard_writemultidone();
+#endif
+}
+
 /*
-  Create a file in the root directory of the new FAT32 filesystem
-  with the indicated name and size.
+  Create a file in the directory starting at dir_cluster (e.g., from
+  fat32_current_dir_cluster()) with the indicated name and size.
 
   The file will be created contiguous on disk, and the first
   sector of the created file returned.
 
-  The root directory is the start of cluster 2, and clusters are
-  assumed to be 4KB in size, to keep things simple.
-
-  XXX -- Should allow creation of files in sub-directories
-
 */
-long fat32_create_contiguous_file(char* name, long size, long root_dir_sector, long fat1_sector, long fat2_sector)
+long fat32_create_contiguous_file(char* name, long size, unsigned long dir_cluster)
 {
-  unsigned char i, sn, len;
-  unsigned short offset, j;
+  unsigned char i, sn;
+  unsigned short j;
   unsigned short clusters;
-  unsigned long k, start_cluster = 0;
-  unsigned long dir_cluster = 2;
-  unsigned long last_dir_cluster = 2;
-  unsigned long next_cluster;
-  unsigned long contiguous_clusters = 0;
-  unsigned long fat_sector_num = 0;
-  unsigned long fat_sector_count = 0;
-
-  unsigned char have_dir_slot = 0;
+  unsigned long start_cluster = 0;
+  unsigned char raw_name[11];
+
   unsigned long free_dir_sector_num = 0;
   unsigned short free_dir_sector_ofs = 0;
   struct m65_tm tm;
 
-  char message[40] = "Found file: ????????.???";
-
-  clusters = size / (512 * sectors_per_cluster);
-  if (size % (512 * sectors_per_cluster))
+  clusters = size / (512L * sectors_per_cluster);
+  if (size % (512L * sectors_per_cluster))
     clusters++;
 
-  // Look for a free directory slot.
-  // Also complain if the file already exists
-  mega65_serial_monitor_write("Search for free directory slot\n");
-  while (dir_cluster >= 2 && dir_cluster < 0xf0000000) {
-    for (sn = 0; sn < sectors_per_cluster; sn++) {
-      sdcard_readsector(root_dir_sector + ((dir_cluster - 2) * sectors_per_cluster) + sn);
-      for (offset = 0; offset < 512; offset += 32) {
-        for (i = 0; i < 8; i++)
-          message[i] = sector_buffer[offset + i];
-        len = 8;
-        while (len && (message[len] == ' ' || message[len] == 0))
-          len--;
-        message[len++] = '.';
-        for (i = 0; i < 3; i++)
-          message[len + i] = sector_buffer[offset + 8 + i];
-        len += 3;
-        while (len && (message[len] == ' ' || message[len] == 0))
-          len--;
-        if (!strcmp(message, name)) {
-          // ERROR: Name already exists
-          mega65_serial_monitor_write("File already exists\n");
-          return 0;
-        }
-        // Is the slot free?
-        if (sector_buffer[offset] == 0) {
-          free_dir_sector_num = root_dir_sector + ((dir_cluster - 2) * sectors_per_cluster) + sn;
-          free_dir_sector_ofs = offset;
-          have_dir_slot = 1;
-          mega65_serial_monitor_write("Found free directory slot:\n");
-          serial_hex(dir_cluster);
-          serial_hex(sn);
-          serial_hex(offset);
-
-          break;
-        }
-      }
-      if (have_dir_slot)
-        break;
+  // Complain if the file already exists
+  fat32_raw_name(name, raw_name);
+  if (dir_cluster != dirindex_cluster) {
+    mega65_serial_monitor_write("Indexing directory\n");
+    if (fat32_index_directory(dir_cluster, raw_name)) {
+      mega65_serial_monitor_write("File already exists\n");
+      return 0;
     }
-    // Stop once we have found a free directory slot
-    if (have_dir_slot)
-      break;
+  }
+  else if (dirindex_probe(raw_name, 0)) {
+    mega65_serial_monitor_write("File already exists\n");
+    return 0;
+  }
 
-    // Chain to next directory cluster, and extend directory
-    // if required.
-    last_dir_cluster = dir_cluster;
-    dir_cluster = fat32_follow_cluster(dir_cluster);
-    if ((!dir_cluster) || (dir_cluster >= 0x0f000000)) {
+  // Look for a free directory slot, extending the directory if required
+  mega65_serial_monitor_write("Search for free directory slot\n");
+  if (dirindex_free_count) {
+    // Reuse a deleted entry
+    dirindex_free_count--;
+    free_dir_sector_num = dirindex_free_sector[dirindex_free_count];
+    free_dir_sector_ofs = dirindex_free_offset[dirindex_free_count];
+  }
+  else {
+    if (!dirindex_end_sector) {
       // End of directory --
-      dir_cluster = fat32_allocate_cluster(last_dir_cluster);
+      dir_cluster = fat32_allocate_cluster(dirindex_last_cluster);
 
       mega65_serial_monitor_write("Allocating new directory cluster");
       serial_hex(dir_cluster);
 
-      if ((!dir_cluster) || (dir_cluster >= 0x0f000000)) {
+      if (!dir_cluster) {
         // Disk full
+        dirindex_cluster = 0;
         return 0;
       }
-      else {
-        // Zero out new directory cluster
-        mega65_serial_monitor_write("Zeroing out new directory cluster\n");
-        serial_hex(dir_cluster);
-        clear_sector_buffer();
-        for (sn = 0; sn < sectors_per_cluster; sn++) {
-          sdcard_writesector(root_dir_sector + ((dir_cluster - 2) * sectors_per_cluster) + sn, 0);
-        }
-      }
+      // Zero out new directory cluster
+      mega65_serial_monitor_write("Zeroing out new directory cluster\n");
+      clear_sector_buffer();
+      for (sn = 0; sn < sectors_per_cluster; sn++)
+        sdcard_writesector(fat32_cluster_sector(dir_cluster) + sn, 0);
+      dirindex_last_cluster = dir_cluster;
+      dirindex_end_sector = fat32_cluster_sector(dir_cluster);
+      dirindex_end_offset = 0;
+    }
+    // Take the end of directory marker, and move it along one
+    free_dir_sector_num = dirindex_end_sector;
+    free_dir_sector_ofs = dirindex_end_offset;
+    dirindex_end_offset += 32;
+    if (dirindex_end_offset == 512) {
+      dirindex_end_offset = 0;
+      dirindex_end_sector++;
+      if (dirindex_end_sector == fat32_cluster_sector(dirindex_last_cluster) + sectors_per_cluster)
+        dirindex_end_sector = 0;
     }
   }
+  mega65_serial_monitor_write("Found free directory slot:\n");
+  serial_hex(free_dir_sector_num);
+  serial_hex(free_dir_sector_ofs);
 
   // Find where we have enough contiguous space
   mega65_serial_monitor_write("Search for free disk space\n");
-  contiguous_clusters = 0;
-  start_cluster = 0;
-  for (fat_sector_num = 0; fat_sector_num <= (fat2_sector - fat1_sector); fat_sector_num++) {
-
-    // This can take a while if the disk is full, because we use a naive search.
-    // So show the user that something is happening.
-    // XXX Use FAT32's hint of first cluster free _and_ then update it!
-    POKE(0xD020, PEEK(0xD020 + 1));
-
-    sdcard_readsector(fat1_sector + fat_sector_num);
-
-    // Skip any FAT sectors with allocated clusters
-    for (j = 0; j < 512; j++)
-      if (sector_buffer[j])
-        break;
-    if (j != 512) {
-      // Reset count of contiguous clusters
-      contiguous_clusters = 0;
-      continue;
-    }
-    else {
-      // Start from here
-      if (!contiguous_clusters)
-        start_cluster = fat_sector_num * 128;
-      contiguous_clusters += 128;
-    }
-    if (contiguous_clusters >= clusters)
-      break;
+  if (reserved_clusters >= clusters) {
+    start_cluster = reserved_cluster;
+    reserved_cluster += clusters;
+    reserved_clusters -= clusters;
   }
+  else
+    start_cluster = fat32_find_contiguous(clusters);
 
-  // Abort if the disk is full
-  if (contiguous_clusters < clusters) {
+  // Abort if the disk is full (and forget the directory slot we took). A
+  // directory cluster we added is kept, but its FAT entry must be written
+  // out, as the free count in FSInfo already has it taken.
+  if (!start_cluster) {
     mega65_serial_monitor_write("Could not find free contiguous space\r\n");
+    dirindex_cluster = 0;
+    fat32_sync();
     return 0;
   }
 
@@ -417,27 +886,9 @@ long fat32_create_contiguous_file(char* name, long size, long root_dir_sector, l
 
   // Write cluster chain into both FATs
   mega65_serial_monitor_write("Writing FAT sectors for file\r\n");
-  fat_sector_num = start_cluster / 128;
-  next_cluster = start_cluster + 1;
-  fat_sector_count = clusters / 128;
-  if (clusters & 127)
-    fat_sector_count++;
-  for (k = 0; k <= fat_sector_count; k++) {
-    // Fill FAT sector with chain
-    for (offset = 0; offset < 512; offset += 4) {
-      if (((k << 7) + (offset >> 2)) < clusters) {
-        // Write chain
-        *(unsigned long*)&sector_buffer[offset] = start_cluster + (k << 7) + (offset >> 2) + 1;
-      }
-      if (((k << 7) + (offset >> 2)) == (clusters - 1)) {
-        // Mark end of chain
-        *(unsigned long*)&sector_buffer[offset] = 0x0FFFFFF8;
-      }
-    }
-    // Write FAT sector to both FATs
-    sdcard_writesector(fat1_sector + fat_sector_num + k, 0);
-    sdcard_writesector(fat2_sector + fat_sector_num + k, 0);
-  }
+  fat32_write_chain(start_cluster, clusters);
+  fat32_sync();
+  fat32_update_fsinfo(start_cluster + clusters, clusters);
 
   // Build directory entry
   mega65_serial_monitor_write("Building directory entry\r\n");
@@ -446,16 +897,9 @@ long fat32_create_contiguous_file(char* name, long size, long root_dir_sector, l
   for (i = 0; i < 32; i++)
     sector_buffer[free_dir_sector_ofs + i] = 0x00;
   // Write name
-  // Fill name with space
-  for (i = 0; i < 11; i++)
-    sector_buffer[free_dir_sector_ofs + i] = 0x20;
-  // Then overwrite with actual name
-  for (i = 0, j = 0; i < 11; i++, j++) {
-    if (name[j] == '.')
-      i = 7;
-    else
-      sector_buffer[free_dir_sector_ofs + i] = name[j];
-  }
+  lcopy((long)raw_name, (long)&sector_buffer[free_dir_sector_ofs], 11);
+  if (dirindex_cluster)
+    dirindex_probe(raw_name, 1);
   sector_buffer[free_dir_sector_ofs + 0x0b] = 0x20; // Archive bit set
 
   mega65_serial_monitor_write("Getting RTC timestamp\r\n");
@@ -493,5 +937,5 @@ long fat32_create_contiguous_file(char* name, long size, long root_dir_sector, l
   mega65_serial_monitor_write("@ offset $");
   serial_hex(free_dir_sector_ofs);
 
-  return root_dir_sector + (start_cluster - 2) * 8;
+  return fat32_cluster_sector(start_cluster);
 }
@@ -4,8 +4,34 @@
 extern unsigned long root_dir_sector;
 extern unsigned long fat1_sector;
 extern unsigned long fat2_sector;
+extern unsigned char sectors_per_cluster;
+extern unsigned long root_dir_cluster;
+extern unsigned long cluster_count;
+// Hints from the FSInfo sector (FSINFO_UNKNOWN if not known)
+#define FSINFO_UNKNOWN 0xffffffffUL
+extern unsigned long fsinfo_free_clusters;
+extern unsigned long fsinfo_next_free;
 
-long fat32_create_contiguous_file(char* name, long size, long root_dir_sector, long fat1_sector, long fat2_sector);
+// First sector of a cluster (root_dir_sector is where cluster 2 begins)
+#define fat32_cluster_sector(cluster) (root_dir_sector + ((cluster) - 2) * sectors_per_cluster)
+// Clusters at or above this mark the end of a chain
+#define FAT32_END_OF_CHAIN 0x0ffffff8UL
+
+long fat32_create_contiguous_file(char* name, long size, unsigned long dir_cluster);
 unsigned char fat32_open_file_system(void);
+unsigned long fat32_current_dir_cluster(void);
+unsigned long fat32_follow_cluster(unsigned long cluster);
+unsigned long fat32_find_contiguous(unsigned long clusters);
+void fat32_set_cluster(unsigned long cluster, unsigned long value);
+void fat32_sync(void);
+void fat32_write_chain(unsigned long start_cluster, unsigned long clusters);
+void fat32_update_fsinfo(unsigned long next_free, long allocated);
+unsigned long fat32_free_chain(unsigned long cluster);
+unsigned long fat32_reserve(unsigned long clusters);
+void fat32_release(void);
+unsigned char* fat32_find_entry(unsigned long dir_cluster, char* name);
+unsigned long fat32_find_file(unsigned long dir_cluster, char* name, unsigned long* size);
+unsigned char fat32_read_chain(unsigned long cluster, long address, unsigned short sectors);
+void fat32_write_sectors(unsigned long sector, long address, unsigned char count);
 
 #endif /* __FDISK_FAT32_H__ */
\ No newline at end of file
@@ -0,0 +1,210 @@
+/*
+  Map of the free space on the SD card, in attic RAM.
+
+  See fdisk_fatmap.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_fat32.h"
+#include "fdisk_fatmap.h"
+
+unsigned char fatmap_state = FATMAP_UNBUILT;
+unsigned short fatmap_count;
+
+// Extents are worked on a chunk at a time in lburst_buffer
+#define FATMAP_CHUNK (LBURST_BUFFER_SIZE / sizeof(struct fatmap_extent))
+#define fatmap_chunk ((struct fatmap_extent*)lburst_buffer)
+
+static struct fatmap_extent extent;
+
+static void fatmap_get(unsigned short e)
+{
+  lcopy(fatmap_extent_address(e), (long)&extent, sizeof(extent));
+}
+
+static void fatmap_put(unsigned short e)
+{
+  lcopy((long)&extent, fatmap_extent_address(e), sizeof(extent));
+}
+
+static void fatmap_remove(unsigned short e)
+{
+  // Order doesn't matter, so the last extent takes its place
+  fatmap_count--;
+  if (e != fatmap_count)
+    lcopy(fatmap_extent_address(fatmap_count), fatmap_extent_address(e), sizeof(extent));
+}
+
+static void fatmap_append(uint32_t start, uint32_t length)
+{
+  if (fatmap_count == FATMAP_MAX_EXTENTS) {
+    fatmap_state = FATMAP_UNUSABLE;
+    return;
+  }
+  extent.start = start;
+  extent.length = length;
+  fatmap_put(fatmap_count++);
+}
+
+static void fatmap_build(void)
+{
+  // Read through the FAT once, collecting runs of free clusters in
+  // lburst_buffer, and writing them out a chunk at a time.
+  uint32_t cluster, run_start = 0, run = 0;
+  unsigned short i;
+  unsigned char n = 0;
+
+  fatmap_count = 0;
+  fatmap_state = FATMAP_UNUSABLE;
+  if (!sectors_per_cluster)
+    return;
+  fat32_sync();
+
+  for (cluster = 0; cluster <= cluster_count; cluster++) {
+    if (cluster < cluster_count) {
+      if (!(cluster & 127)) {
+        // This takes a while on a big card, so show that something is happening
+        POKE(0xD020, PEEK(0xD020) + 1);
+        sdcard_readsector(fat1_sector + (cluster >> 7));
+
+        // Skip whole free FAT sectors
+        if (cluster + 128 <= cluster_count) {
+          for (i = 0; i < 512; i++)
+            if (sector_buffer[i])
+              break;
+          if (i == 512) {
+            if (!run)
+              run_start = cluster;
+            run += 128;
+            cluster += 127;
+            continue;
+          }
+        }
+      }
+      if (cluster >= 2 && !(*(uint32_t*)&sector_buffer[(cluster & 127) << 2] & 0x0fffffffUL)) {
+        if (!run)
+          run_start = cluster;
+        run++;
+        continue;
+      }
+    }
+
+    // End of a run (or of the FAT)
+    if (run) {
+      if (fatmap_count + n == FATMAP_MAX_EXTENTS)
+        return;
+      fatmap_chunk[n].start = run_start;
+      fatmap_chunk[n].length = run;
+      if (++n == FATMAP_CHUNK) {
+        lburst_write(fatmap_extent_address(fatmap_count), n * sizeof(struct fatmap_extent));
+        fatmap_count += n;
+        n = 0;
+      }
+      run = 0;
+    }
+  }
+  lburst_write(fatmap_extent_address(fatmap_count), n * sizeof(struct fatmap_extent));
+  fatmap_count += n;
+
+  fatmap_state = FATMAP_READY;
+}
+
+unsigned char fatmap_open(void)
+{
+  if (fatmap_state == FATMAP_UNBUILT)
+    fatmap_build();
+  return fatmap_state == FATMAP_READY;
+}
+
+uint32_t fatmap_find(uint32_t clusters)
+{
+  uint32_t best = 0, best_length = 0xffffffffUL;
+  unsigned short e;
+  unsigned char i, n;
+
+  if (!fatmap_open())
+    return 0;
+
+  for (e = 0; e < fatmap_count; e += n) {
+    n = (fatmap_count - e < FATMAP_CHUNK) ? fatmap_count - e : FATMAP_CHUNK;
+    lburst_read(fatmap_extent_address(e), n * sizeof(struct fatmap_extent));
+    for (i = 0; i < n; i++)
+      if (fatmap_chunk[i].length >= clusters && fatmap_chunk[i].length < best_length) {
+        best = fatmap_chunk[i].start;
+        best_length = fatmap_chunk[i].length;
+        if (best_length == clusters)
+          return best;
+      }
+  }
+  return best;
+}
+
+void fatmap_allocate(uint32_t start, uint32_t clusters)
+{
+  // Take clusters out of whichever extent they are in
+  uint32_t end = start + clusters, extent_end;
+  unsigned short e;
+
+  if (fatmap_state != FATMAP_READY)
+    return;
+
+  for (e = 0; e < fatmap_count; e++) {
+    fatmap_get(e);
+    extent_end = extent.start + extent.length;
+    if (start < extent.start || start >= extent_end)
+      continue;
+
+    if (end >= extent_end && start == extent.start)
+      fatmap_remove(e);
+    else if (start == extent.start) {
+      extent.start = end;
+      extent.length = extent_end - end;
+      fatmap_put(e);
+    }
+    else {
+      extent.length = start - extent.start;
+      fatmap_put(e);
+      if (end < extent_end)
+        fatmap_append(end, extent_end - end);
+    }
+    return;
+  }
+}
+
+void fatmap_free(uint32_t start, uint32_t clusters)
+{
+  // Put clusters back, joining them to the extents either side
+  uint32_t end = start + clusters;
+  unsigned short e, before = 0xffff, after = 0xffff;
+
+  if (fatmap_state != FATMAP_READY)
+    return;
+
+  for (e = 0; e < fatmap_count; e++) {
+    fatmap_get(e);
+    if (extent.start + extent.length == start)
+      before = e;
+    if (extent.start == end) {
+      after = e;
+      clusters += extent.length;
+    }
+  }
+
+  if (after != 0xffff) {
+    fatmap_remove(after);
+    // The one before might have been moved into its place
+    if (before == fatmap_count)
+      before = after;
+  }
+  if (before != 0xffff) {
+    fatmap_get(before);
+    extent.length += clusters;
+    fatmap_put(before);
+  }
+  else
+    fatmap_append(start, clusters);
+}
@@ -0,0 +1,45 @@
+#ifndef __FDISK_FATMAP_H__
+#define __FDISK_FATMAP_H__
+
+/*
+  Map of the free space on the SD card, in attic RAM.
+
+  Finding room for a disk image by reading the FAT means reading a FAT
+  sector for every 128 clusters that are in the way, every time. Instead,
+  the first time a tool needs free space, fatmap_open() reads the whole FAT
+  once, and keeps the runs of free clusters as a list of extents. After
+  that, fatmap_find() answers from the list alone, picking the smallest
+  extent that is big enough, so that big holes are kept for big images.
+
+  fat32_write_chain() tells the map about every cluster it allocates, and
+  anything that frees clusters calls fatmap_free(), so the map stays in step
+  for as long as the tool runs. It is not trusted from one tool to the next,
+  as the card could have been written to in between.
+
+  The extents are kept in no particular order. If there are too many of
+  them, the map gives up, and the callers go back to reading the FAT.
+*/
+
+#define FATMAP_MAX_EXTENTS 8192
+#define fatmap_extent_address(e) (ATTIC_FATMAP_ADDRESS + ((long)(e) << 3))
+
+#define FATMAP_UNBUILT 0
+#define FATMAP_READY 1
+#define FATMAP_UNUSABLE 2
+
+struct fatmap_extent {
+  uint32_t start;
+  uint32_t length; // in clusters
+};
+
+extern unsigned char fatmap_state;
+extern unsigned short fatmap_count;
+
+// Build the map if that hasn't been done yet. Returns non-zero if it can be used.
+unsigned char fatmap_open(void);
+// First cluster of the best fitting free extent, or 0 if none is big enough
+uint32_t fatmap_find(uint32_t clusters);
+void fatmap_allocate(uint32_t start, uint32_t clusters);
+void fatmap_free(uint32_t start, uint32_t clusters);
+
+#endif /* __FDISK_FATMAP_H__ */
@@ -19,3 +19,4 @@ void sdcard_map_sector_buffer(void);
 void usleep(uint32_t micros);
 void sdcard_writenextsector(void);
 void sdcard_writemultidone(void);
+void mega65_serial_monitor_write(char* s);
@@ -4,6 +4,7 @@
 #include "fdisk_hal.h"
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
+#include "freezer_prof.h"
 #include "ascii.h"
 
 #define POKE(X, Y) (*(unsigned char*)(X)) = Y
@@ -181,6 +182,21 @@ void sdcard_readsector(const uint32_t sector_number)
   }
 }
 
+void mega65_serial_monitor_write(char* s)
+{
+  while (*s) {
+    // There is almost certainly a better way to do this, but it works.
+    POKE(0x380, *s);
+    __asm__("lda $0380");
+
+    // Use CLC in the spare instruction slot, in case assembler tries to
+    // optimise a NOP away.
+    __asm__("sta $d643");
+    __asm__("clc");
+    s++;
+  }
+}
+
 uint8_t verify_buffer[512];
 
 void sdcard_writesector(const uint32_t sector_number, uint8_t is_multi)
@@ -191,6 +207,8 @@ void sdcard_writesector(const uint32_t sector_number, uint8_t is_multi)
   char tries = 0, result;
   uint16_t counter = 0;
 
+  PROF_BEGIN(PROF_SDCARD_WRITE);
+
   // Set address to read/write
   POKE(sd_ctl, 1); // end reset
   if (!sdhc_card)
@@ -230,6 +248,7 @@ void sdcard_writesector(const uint32_t sector_number, uint8_t is_multi)
       break;
   }
   if (i == 512) {
+    PROF_END(PROF_SDCARD_WRITE);
     return;
   }
 
@@ -328,6 +347,7 @@ void sdcard_writesector(const uint32_t sector_number, uint8_t is_multi)
         //      screen_hex(screen_line_address-80+2+14,sector_number);
         //      screen_hex(screen_line_address-80+2+30,result);
 
+        PROF_END(PROF_SDCARD_WRITE);
         return;
       }
     }
@@ -338,6 +358,7 @@ void sdcard_writesector(const uint32_t sector_number, uint8_t is_multi)
 
   //  write_line("Write error @ $$$$$$$$$",2);
   //  screen_hex(screen_line_address-80+2+16,sector_number);
+  PROF_END(PROF_SDCARD_WRITE);
 }
 
 void sdcard_writenextsector(void)
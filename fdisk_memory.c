@@ -10,12 +10,14 @@
 
 struct dmagic_dmalist {
   // Enhanced DMA options
-  unsigned char option_0b;
-  unsigned char option_80;
+  unsigned char option_0b; // $0B = use F018B format list
+  unsigned char option_85; // $85 = destination skip rate follows
+  unsigned char dest_skip; // bytes between destination writes (1 = none)
+  unsigned char option_80; // $80 = source MB follows
   unsigned char source_mb;
-  unsigned char option_81;
+  unsigned char option_81; // $81 = destination MB follows
   unsigned char dest_mb;
-  unsigned char end_of_options;
+  unsigned char end_of_options; // $00 = end of options
 
   // F018B format DMA request
   unsigned char command;
@@ -28,7 +30,13 @@ struct dmagic_dmalist {
   unsigned int modulo;
 };
 
-struct dmagic_dmalist dmalist;
+// The destination skip rate is only changed by the *_stride() functions,
+// which put it back to 1 when done, so it is not set up for every job.
+struct dmagic_dmalist dmalist = {
+  0x0b, // F018B format list
+  0x85, // destination skip rate option
+  1 // write every byte
+};
 unsigned char dma_byte;
 
 void do_dma(void)
@@ -187,6 +195,52 @@ void lfill(long destination_address, unsigned char value, unsigned int count)
   return;
 }
 
+void lcopy_stride(long source_address, long destination_address, unsigned int count, unsigned char stride)
+{
+  dmalist.dest_skip = stride;
+  lcopy(source_address, destination_address, count);
+  dmalist.dest_skip = 1;
+}
+
+void lfill_stride(long destination_address, unsigned char value, unsigned int count, unsigned char stride)
+{
+  dmalist.dest_skip = stride;
+  lfill(destination_address, value, count);
+  dmalist.dest_skip = 1;
+}
+
+unsigned char lburst_buffer[LBURST_BUFFER_SIZE];
+
+unsigned char* lburst_read(long address, unsigned int count)
+{
+  lcopy(address, (long)lburst_buffer, count);
+  return lburst_buffer;
+}
+
+void lburst_write(long address, unsigned int count)
+{
+  lcopy((long)lburst_buffer, address, count);
+}
+
+void lmask(long address, unsigned int count, unsigned char stride, unsigned char and_mask, unsigned char or_mask)
+{
+  unsigned int chunk, i;
+
+  // Keep each chunk a multiple of stride, so that the bytes we modify stay
+  // in phase from one chunk to the next
+  chunk = LBURST_BUFFER_SIZE - (LBURST_BUFFER_SIZE % stride);
+  while (count) {
+    if (chunk > count)
+      chunk = count;
+    lcopy(address, (long)lburst_buffer, chunk);
+    for (i = 0; i < chunk; i += stride)
+      lburst_buffer[i] = (lburst_buffer[i] & and_mask) | or_mask;
+    lcopy((long)lburst_buffer, address, chunk);
+    address += chunk;
+    count -= chunk;
+  }
+}
+
 void m65_io_enable(void)
 {
   // Gate C65 IO enable
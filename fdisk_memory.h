@@ -7,6 +7,41 @@ void lpoke(long address, unsigned char value);
 void lcopy(long source_address, long destination_address, unsigned int count);
 void lcopy_safe(unsigned long src, unsigned long dst, unsigned int count);
 void lfill(long destination_address, unsigned char value, unsigned int count);
+// As lcopy() and lfill(), but only write every <stride>th byte of the destination,
+// e.g., to put 8-bit screen codes into the low bytes of a 16-bit text screen.
+// <count> is the number of bytes written, not the size of the destination.
+void lcopy_stride(long source_address, long destination_address, unsigned int count, unsigned char stride);
+void lfill_stride(long destination_address, unsigned char value, unsigned int count, unsigned char stride);
+
+// Burst access to far memory: lburst_read() DMAs a region into lburst_buffer,
+// where it can be edited as a normal array, and lburst_write() puts it back.
+// lmask() does the same for every <stride>th byte of a region of any length,
+// e.g., to change the attribute byte of a whole row in colour RAM in two DMAs.
+#define LBURST_BUFFER_SIZE 256
+extern unsigned char lburst_buffer[LBURST_BUFFER_SIZE];
+unsigned char* lburst_read(long address, unsigned int count);
+void lburst_write(long address, unsigned int count);
+void lmask(long address, unsigned int count, unsigned char stride, unsigned char and_mask, unsigned char or_mask);
+
+// Attic RAM (the 8MB of HyperRAM at $8000000) is not part of a freeze slot,
+// so it keeps its contents from one freezer tool to the next. The tools keep
+// their data at the top of it, and always check a magic value before trusting
+// what is there, as it might not exist, or a programme might have used it.
+// By the same token, whatever a frozen programme had in $8300000-$87FFFFF is
+// not saved, and may be overwritten (see "Attic RAM" in README.md).
+#define ATTIC_RAM_ADDRESS 0x8000000L
+#define ATTIC_TEMPLATE_ADDRESS 0x8300000L // blank disk image for MAKEDISK (3MB)
+#define ATTIC_DIRCACHE_ADDRESS 0x8600000L // directory listings (1MB)
+#define ATTIC_PREVIEW_ADDRESS 0x8700000L // disk image directory previews (64KB)
+#define ATTIC_CHARSET_ADDRESS 0x8710000L // default font for the chargen area (32KB)
+#define ATTIC_HANDOFF_ADDRESS 0x8718000L // state handed from one tool to the next (32KB)
+#define ATTIC_TOOLCACHE_ADDRESS 0x8720000L // freezer tools (up to 512KB, as much as the tools started take)
+#define ATTIC_DIRINDEX_ADDRESS 0x87A0000L // names in the directory files are created in (128KB)
+#define ATTIC_COPY_ADDRESS 0x87C0000L // sectors on their way from one place to another (64KB)
+#define ATTIC_FATCACHE_ADDRESS 0x87D0000L // FAT sectors (64KB)
+#define ATTIC_FATMAP_ADDRESS 0x87E0000L // free space on the SD card (64KB)
+#define ATTIC_PROF_ADDRESS 0x87F0000L // profiling ring buffer (64KB)
+
 #define POKE(X, Y) (*(unsigned char*)(X)) = Y
 #define PEEK(X) (*(unsigned char*)(X))
 
@@ -54,8 +54,7 @@ void format_hex(const int addr, const long value, const char columns)
     dec[7] = ' ';
     c--;
   }
-  for (i = 0; i < columns; i++)
-    lpoke(addr + i, dec[i]);
+  lcopy((long)dec, addr, columns);
 }
 
 unsigned char screen_decimal_digits[16][5] = { { 0, 0, 0, 0, 1 }, { 0, 0, 0, 0, 2 }, { 0, 0, 0, 0, 4 }, { 0, 0, 0, 0, 8 },
@@ -165,12 +164,10 @@ void screen_decimal(unsigned int addr, unsigned int v)
 
 void format_decimal(const int addr, const int value, const char columns)
 {
-  char i;
   char dec[6];
   screen_decimal((int)&dec[0], value);
 
-  for (i = 0; i < columns; i++)
-    lpoke(addr + i, dec[i]);
+  lcopy((long)dec, addr, columns);
 }
 
 long addr;
@@ -257,14 +254,9 @@ void fatal_error(unsigned char* filename, unsigned int line_number)
 
 void set_screen_attributes(long p, unsigned char count, unsigned char attr)
 {
-  // This involves setting colour RAM values, so we need to either LPOKE, or
-  // map the 2KB colour RAM in at $D800 and work with it there.
-  // XXX - For now we are LPOKING
-  long addr = COLOUR_RAM_ADDRESS - SCREEN_ADDRESS + p;
-  for (i = 0; i < count; i++) {
-    lpoke(addr, lpeek(addr) | attr);
-    addr++;
-  }
+  // This involves setting colour RAM values, so we need to either burst them
+  // through near memory, or map the 2KB colour RAM in at $D800 and work with it there.
+  lmask(COLOUR_RAM_ADDRESS - SCREEN_ADDRESS + p, count, 1, 0xff, attr);
 }
 
 char read_line(char* buffer, unsigned char maxlen)
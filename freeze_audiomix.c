@@ -7,66 +7,12 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_sched.h"
 #include "ascii.h"
+#include "audiomix_tpl.h"
 
 #ifdef WITH_AUDIOMIXER
 
-unsigned char* audio_menu = (unsigned char *)
-                            "         MEGA65 AUDIO MIXER MENU        "
-                            "  (C) FLINDERS UNI, M.E.G.A. 2018-2024  "
-                            " cccccccccccccccccccccccccccccccccccccc "
-                            "        LFT RGT PH1 PH2 BTL BTR HDL HDR "
-                            "        cccccccccccccccccccccccccccccccc"
-                            "   SIDLb                                "
-                            "   SIDRb                                "
-                            " PHONE1b                                "
-                            " PHONE2b                                "
-                            "BTOOTHLb                                "
-                            "BTOOTHRb                                "
-                            "LINEINLb                                "
-                            "LINEINRb                                "
-                            "  DIGILb                                "
-                            "  DIGIRb                                "
-                            "  MIC0Lb                                "
-                            "  MIC0Rb                                "
-                            "  MIC1Lb                                "
-                            "  MIC1Rb                                "
-                            " OPL FMb                                "
-                            " MASTERb                                "
-                            " cccccccccccccccccccccccccccccccccccccc "
-                            " T - TEST SOUND, CURSOR KEYS - NAVIGATE "
-                            " +/- ADJUST VALUE,    0/* - FAST ADJUST "
-                            " F3 - SIMPLE MODE,  M - TOGGLE MIC MUTE "
-                            "\0";
-
-unsigned char* audio_menu_simple = (unsigned char *)
-                                   "         MEGA65 AUDIO MIXER MENU        "
-                                   "  (C) FLINDERS UNI, M.E.G.A. 2018-2024  "
-                                   " cccccccccccccccccccccccccccccccccccccc "
-                                   "                                        "
-                                   "         LEFT OUTPUT CHANNEL:           "
-                                   "        cccccccccccccccccccccccccccccccc"
-                                   "    MASTERb                             "
-                                   " L SID 3+4b                             "
-                                   " R SID 1+2b                             "
-                                   " LEFT DIGIb                             "
-                                   "RIGHT DIGIb                             "
-                                   "SFX OPL FMb                             "
-                                   "                                        "
-                                   "        RIGHT OUTPUT CHANNEL:           "
-                                   "        cccccccccccccccccccccccccccccccc"
-                                   "    MASTERb                             "
-                                   " L SID 3+4b                             "
-                                   " R SID 1+2b                             "
-                                   " LEFT DIGIb                             "
-                                   "RIGHT DIGIb                             "
-                                   "SFX OPL FMb                             "
-                                   " cccccccccccccccccccccccccccccccccccccc "
-                                   " T - TEST SOUND, CURSOR KEYS - NAVIGATE "
-                                   " +/- VOL, S - STEREO/MONO, W - SWAP L/R "
-                                   " F3 - EXIT, M - MUTE, A - ADVANCED MODE "
-                                   "\0";
-
 void audioxbar_setcoefficient(uint8_t n, uint8_t value)
 {
   // Select the coefficient
@@ -154,19 +100,8 @@ void draw_advanced_mixer(void)
 
   // Update the coefficients in the audio_menu display, then
   // display it after, so that we have no flicker
-
-  // Freezer can't use printf() etc, because C64 ROM has not started, so ZP will be a mess
-  // (in fact, most of memory contains what the frozen program had. Only our freezer program
-  // itself has been loaded to replace some of RAM).
-  for (i = 0; audio_menu[i]; i++) {
-    if ((audio_menu[i] >= 'A') && (audio_menu[i] <= 'Z'))
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu[i] - 0x40);
-    else if ((audio_menu[i] >= 'a') && (audio_menu[i] <= 'z'))
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu[i] - 0x20);
-    else
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu[i]);
-    POKE(SCREEN_ADDRESS + i * 2 + 1, 0);
-  }
+  lcopy_stride((long)audio_menu, SCREEN_ADDRESS + 0, AUDIO_MENU_ROWS * 40, 2);
+  lfill_stride(SCREEN_ADDRESS + 1, 0, AUDIO_MENU_ROWS * 40, 2);
 }
 
 // clang-format off
@@ -224,7 +159,6 @@ void val_to_db(unsigned int val)
     db++;
 }
 
-unsigned char msg[11];
 void draw_db_bar(unsigned char line, unsigned int val)
 {
   unsigned int bar_addr = (unsigned int)audio_menu_simple + line * 40 + 11;
@@ -253,9 +187,7 @@ void draw_db_bar(unsigned char line, unsigned int val)
   // And the annotation to the right
   bar_addr += 23;
   if (!db) {
-    snprintf((char *)msg, 10, "  0DB");
-    for (i = 0; msg[i]; i++)
-      POKE(bar_addr + i, msg[i]);
+    lcopy((long)zero_db_label, bar_addr, ZERO_DB_LABEL_LEN);
   }
   else {
     i = 0;
@@ -269,9 +201,9 @@ void draw_db_bar(unsigned char line, unsigned int val)
     i++;
     for (; numbers[db][i - 1]; i++)
       POKE(bar_addr + i, numbers[db][i - 1]);
-    POKE(bar_addr + i, 'D');
+    POKE(bar_addr + i, 'D' - 0x40);
     i++;
-    POKE(bar_addr + i, 'B');
+    POKE(bar_addr + i, 'B' - 0x40);
     i++;
     for (; i < 5; i++)
       POKE(bar_addr + i, ' ');
@@ -529,18 +461,8 @@ void draw_simple_mixer(void)
   v |= audioxbar_getcoefficient(c + 1) << 8;
   draw_db_bar(20, v);
 
-  // Freezer can't use printf() etc, because C64 ROM has not started, so ZP will be a mess
-  // (in fact, most of memory contains what the frozen program had. Only our freezer program
-  // itself has been loaded to replace some of RAM).
-  for (i = 0; audio_menu_simple[i]; i++) {
-    if ((audio_menu_simple[i] >= '@') && (audio_menu_simple[i] <= 'Z'))
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu_simple[i] - 0x40);
-    else if ((audio_menu_simple[i] >= 'b') && (audio_menu_simple[i] <= 'c'))
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu_simple[i] - 0x20);
-    else
-      POKE(SCREEN_ADDRESS + i * 2 + 0, audio_menu_simple[i]);
-    POKE(SCREEN_ADDRESS + i * 2 + 1, 0);
-  }
+  lcopy_stride((long)audio_menu_simple, SCREEN_ADDRESS + 0, AUDIO_MENU_SIMPLE_ROWS * 40, 2);
+  lfill_stride(SCREEN_ADDRESS + 1, 0, AUDIO_MENU_SIMPLE_ROWS * 40, 2);
 
   // Work out the line to highlight
 
@@ -575,6 +497,7 @@ void test_audio(unsigned char advanced_view)
 
   // Reset all sids
   lfill(0xffd3400, 0, 0x100);
+  sched_init();
 
   // Full volume on all SIDs
   POKE(0xD418U, 0x0f);
@@ -604,25 +527,22 @@ void test_audio(unsigned char advanced_view)
     POKE(sid_addr + 4, 0x11);
 
     if (advanced_view) {
-      // Highlight the appropriate part of the screen
-      for (i = 5 * 80; i < 7 * 80; i += 2)
-        lpoke(0xff80001L + i, lpeek(0xff80001L + i) & 0x0f);
+      // Highlight the appropriate part of the screen. The low nybble of each
+      // colour RAM byte is the colour and the high one the attributes
+      // ($20 = reverse, $40 = bold), so clear those and then set them
+      lmask(0xff80001L + 5 * 80, 2 * 80, 2, 0x0f, 0x00);
       switch (sid_num) {
       case 0:
-        for (i = 0; i < 80; i += 2)
-          lpoke(0xff80001L + 6 * 80 + i, lpeek(0xff80001L + 6 * 80 + i) | 0x20);
+        lmask(0xff80001L + 6 * 80, 80, 2, 0xff, 0x20);
         break;
       case 1:
-        for (i = 0; i < 80; i += 2)
-          lpoke(0xff80001L + 6 * 80 + i, lpeek(0xff80001L + 6 * 80 + i) | 0x60);
+        lmask(0xff80001L + 6 * 80, 80, 2, 0xff, 0x60);
         break;
       case 2:
-        for (i = 0; i < 80; i += 2)
-          lpoke(0xff80001L + 5 * 80 + i, lpeek(0xff80001L + 5 * 80 + i) | 0x20);
+        lmask(0xff80001L + 5 * 80, 80, 2, 0xff, 0x20);
         break;
       case 3:
-        for (i = 0; i < 80; i += 2)
-          lpoke(0xff80001L + 5 * 80 + i, lpeek(0xff80001L + 5 * 80 + i) | 0x60);
+        lmask(0xff80001L + 5 * 80, 80, 2, 0xff, 0x60);
         break;
       }
     }
@@ -655,21 +575,16 @@ void test_audio(unsigned char advanced_view)
     */
     for (frames = 0; frames < 35; frames++) {
       // Make sure all 4 SIDs remain active
-      // by proding while waiting
-      while (PEEK(0xD012U) != 0x80) {
-        POKE(0xD438U, 0x0f);
-        POKE(0xD478U, 0x0f);
-      }
-
-      while (PEEK(0xD012U) == 0x80)
-        continue;
+      // by proding once a frame while waiting
+      POKE(0xD438U, 0x0f);
+      POKE(0xD478U, 0x0f);
+      sched_wait_frame();
     }
   }
 
   // Clear highlight
   if (advanced_view) {
-    for (i = 5 * 80; i < 7 * 80; i += 2)
-      lpoke(0xff80001L + i, lpeek(0xff80001L + i) & 0x0f);
+    lmask(0xff80001L + 5 * 80, 2 * 80, 2, 0x0f, 0x00);
   }
   else {
     lcopy((long)db_bar_lowlight, COLOUR_RAM_ADDRESS + 9 * 80, 80);
@@ -687,7 +602,7 @@ void test_audio(unsigned char advanced_view)
     POKE(0xD478U, frames);
   }
   */
-  while (PEEK(0xD012U) != 0x80);
+  sched_wait_frame();
   POKE(0xD418U, 0x0);
   POKE(0xD438U, 0x0);
   POKE(0xD458U, 0x0);
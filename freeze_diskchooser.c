@@ -6,7 +6,9 @@
 
   We get our list of disknames and put them at $40000.
   As we only care about their names, and file names are
-  limited to 64 characters, we can fit ~1000.
+  limited to 64 characters, we can fit ~1000 at a time.
+  Bigger directories are listed a page at a time, see
+  "Directory listing" below.
   In fact, we can only safely mount images with names <32
   characters.
 
@@ -24,7 +26,14 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_sched.h"
+#include "freezer_prof.h"
+#include "freezer_dirlist.h"
+#include "freezer_dircache.h"
+#include "freezer_preview.h"
+#include "freezer_defrag.h"
 #include "ascii.h"
+#include "diskchooser_tpl.h"
 
 extern unsigned short slot_number;
 
@@ -32,12 +41,6 @@ short file_count = 0, min_dir_entry = 0;
 short selection_number = 0;
 short display_offset = 0;
 
-char* reading_disk_list_message = "SCANNING DIRECTORY ...";
-
-char* diskchooser_instructions = "  SELECT DISK IMAGE, THEN PRESS RETURN  "
-                                 "  OR PRESS RUN/STOP TO LEAVE UNCHANGED  "
-                                 "UNMOUNT CURRENT  ";
-
 // use DMA lcopy overlap trick to save space!
 unsigned char normal_row[4] = { 0, 1, 0, 1 };
 unsigned char error_row[4] = { 0, 2, 0, 2 };
@@ -116,90 +119,48 @@ char* hyppoerror_to_screen(unsigned char error)
 #define DISK_TYPE_D64 1
 #define DISK_TYPE_D65 2
 #define DISK_TYPE_D71 3
-static unsigned char disk_type, current_sector, dir_track, entries, cur_row, next_sector, messed_up = 0;
+static unsigned char disk_type, current_sector, dir_track, messed_up = 0;
 static unsigned char current_side = 0, entry_buffer[18] = "\"                 ";
 
-void display_error(unsigned char error)
+void display_message(char* message, unsigned char* colour)
 {
+  // Show a message in place of the title of the directory preview
   unsigned char i;
-  char *errstr;
 
-  POKE(0xD020U, 2);
-  errstr = hyppoerror_to_screen(error);
-  for (i = 0; i < 19 && errstr[i]; i++) {
-    POKE(SCREEN_ADDRESS + (21 * 2) + (i * 2), petscii_to_screen(errstr[i]));
-    lpoke(COLOUR_RAM_ADDRESS + (21 * 2) + 1 + (i * 2), 0x02); // errors are red
-  }
-  lcopy((long)error_row, COLOUR_RAM_ADDRESS + (21 * 2), 4);
+  for (i = 0; i < 19 && message[i]; i++)
+    POKE(SCREEN_ADDRESS + (21 * 2) + (i * 2), petscii_to_screen(message[i]));
+  for (; i < 19; i++)
+    POKE(SCREEN_ADDRESS + (21 * 2) + (i * 2), ' ');
+  lcopy((long)colour, COLOUR_RAM_ADDRESS + (21 * 2), 4);
   lcopy(COLOUR_RAM_ADDRESS + (21 * 2), COLOUR_RAM_ADDRESS + (21 * 2) + 4, 19 * 2 - 4);
 }
 
-void draw_directory_entry(unsigned char screen_row)
+void display_error(unsigned char error)
 {
-  unsigned char i;
-
-  for (i = 0; i < 18; i++)
-    POKE(SCREEN_ADDRESS + (screen_row * 80) + (21 * 2) + (i * 2), entry_buffer[i]);
-
-  lcopy((unsigned long)dir_line_colour, COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2), 4);
-  lcopy(COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2), COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2) + 4, (19 * 2 - 4));
+  // errors are red
+  POKE(0xD020U, 2);
+  display_message(hyppoerror_to_screen(error), error_row);
 }
 
-unsigned char next_directory_entry(void)
+char attach_image(unsigned char drive_id)
 {
-  unsigned char c, i, type = 0;
-
-  if (disk_type == DISK_TYPE_D81 || disk_type == DISK_TYPE_D64) {
-    // D81 || D64
-    i = PEEK(0xD087U); // track next dir
-    c = PEEK(0xD087U); // sector next dir
-    if (next_sector == 255) { // only first two bytes of sector count!
-      if (i > 0 && c > 1 && c < 41) // track 0 means end of dir
-        next_sector = c;
-      else
-        next_sector = 254; // first two bytes of sector read
-    }
-    type = PEEK(0xD087U); // file type
-    c = PEEK(0xD087U); // track file
-    c = PEEK(0xD087U); // sector file
-    // now 16 char filename
-    if (type) { // valid
-      entry_buffer[17] = ' ';
-      for (i = 1; i < 17; i++)
-        entry_buffer[i] = petscii_to_screen(PEEK(0xD087U));
-      for (; (entry_buffer[i] & 0xbf) == ' ' && i > 1; i--); // this might be 0x20 or 0x60
-      entry_buffer[i+1] = '"';
-
-      // skip rest up to 32 bytes
-      for (i = 0; i < 11; i++)
-        c = PEEK(0xD087U);
-    }
-    else
-      for (i = 0; i < 27; i++)
-        c = PEEK(0xD087U);
-  }
-
-  return type;
+  // hyppo attach sets the image enable and present flags for the drive
+  if (drive_id == 0)
+    return mega65_dos_d81attach0(disk_name_return);
+  if (drive_id == 1)
+    return mega65_dos_d81attach1(disk_name_return);
+  return -1;
 }
 
-void draw_entries(void)
+void draw_directory_entry(unsigned char screen_row)
 {
   unsigned char i;
 
-  // next_sector = 255 -> first entry of sector to be read
-  // next_sector = 254 -> first already read, no valid dir pointer
-  // next_sector < 41  -> next dir sector 
-  next_sector = 255;
-  for (i = 0; i < entries; i++) {
-    if (next_directory_entry()) {
-      draw_directory_entry(cur_row);
-      cur_row++;
-    }
-    if (cur_row >= 23)
-      break;
-    if (i == 8) // D81 two sectors at once, so read next pointer
-      next_sector = 255;
-  }
+  for (i = 0; i < 18; i++)
+    POKE(SCREEN_ADDRESS + (screen_row * 80) + (21 * 2) + (i * 2), entry_buffer[i]);
+
+  lcopy((unsigned long)dir_line_colour, COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2), 4);
+  lcopy(COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2), COLOUR_RAM_ADDRESS + (screen_row * 80) + (21 * 2) + 4, (19 * 2 - 4));
 }
 
 int read_sector_with_cancel(void)
@@ -228,17 +189,249 @@ int read_sector_with_cancel(void)
   return 1;
 }
 
+/*
+  Directory listing
+
+  The entries after the pseudo disks (and "..") are read in pages of
+  DIRPAGE_ENTRIES, which are kept in DIRPAGE_SLOTS slots of records from
+  min_dir_entry onwards. The first screenful is read straight away, so that
+  it can be drawn, and the rest by scan_job() in the background.
+
+  If the whole directory fits, pages 0, 1, ... just end up in slots 0, 1, ...
+  and the listing is then sorted and cached as before. If not, the least
+  recently used page that is not on the screen makes way for the next one,
+  and the listing stays in directory order, reading pages back in when they
+  are scrolled to. As the hypervisor can only read a directory forwards, that
+  means opening it again and skipping to the page.
+*/
+// Disk image records also keep the start cluster and size of the file, for
+// the directory preview
+#define DIR_RECORD_NAME_LEN 56
+#define DIR_RECORD_CLUSTER 56
+#define DIR_RECORD_FILE_SIZE 60
+
+#define DIRPAGE_ENTRIES 64
+#define DIRPAGE_SLOTS 15
+#define DIRPAGE_NONE 0xffffU
+#define dirpage_address(slot, i) dir_record_address(min_dir_entry + ((slot) << 6) + (i))
+// Where skipped entries go
+#define SCAN_SCRATCH_RECORD dir_record_address(DIRLIST_MAX_ENTRIES)
+// Keep line numbers positive
+#define SCAN_MAX_ENTRIES 0x7ff0
+
+static unsigned short dirpage_page[DIRPAGE_SLOTS]; // page in each slot
+static unsigned short dirpage_age[DIRPAGE_SLOTS], dirpage_clock;
+static unsigned char scan_dir, scan_open = 0;
+static unsigned char scan_complete = 1, scan_paged = 0, listing_sorted = 1;
+static unsigned short scan_pos; // entry the open directory gives next
+static unsigned short scan_known; // entries read so far
+unsigned char listing_dirty = 0; // more of the screen has been read
+
+void scan_stop(void)
+{
+  if (scan_open) {
+    closedir(scan_dir);
+    scan_open = 0;
+  }
+}
+
+unsigned char scan_read(long record)
+{
+  // Read the next entry to list into record.
+  // Returns 0 at the end of the directory.
+  unsigned char x;
+  char* ptr;
+  struct m65_dirent* dirent;
+
+  while (1) {
+    dirent = readdir(scan_dir);
+    if (!dirent || ((unsigned short)dirent == 0xffffU))
+      return 0;
+
+    x = strlen(dirent->d_name);
+
+    // check DIR attribute of dirent
+    if (dirent->d_type & 0x10) {
+      // if there is a .. path, then we are in a subdir, and it goes above
+      // the pages (over the top of makedisk)
+      if (!strcmp("..", dirent->d_name)) {
+        not_in_root = 1;
+        lfill(dir_record_address(min_dir_entry - 1), ' ', 64);
+        lcopy((long)"/..", dir_record_address(min_dir_entry - 1), 3);
+      }
+      // Don't list "." directory pointer
+      else if (x < 60 && strcmp(".", dirent->d_name)) {
+        lfill(record, ' ', 64);
+        lcopy((long)&dirent->d_name[0], record + 1, x);
+        // Put / at the start of directory names to make them obviously different
+        lpoke(record, '/');
+        return 1;
+      }
+    }
+    else if (x > 4) {
+      ptr = &dirent->d_name[x - 4];
+      if ((!strcmp(ptr, ".D81")) || (!strcmp(ptr, ".d81")) || (!strcmp(ptr, ".D64")) || (!strcmp(ptr, ".d64"))
+          || (!strcmp(ptr, ".D65")) || (!strcmp(ptr, ".d65"))) {
+        // File is a disk image
+        lfill(record, ' ', 64);
+        lcopy((long)&dirent->d_name[0], record, x < DIR_RECORD_NAME_LEN ? x : DIR_RECORD_NAME_LEN);
+        lcopy((long)&dirent->d_ino, record + DIR_RECORD_CLUSTER, 4);
+        lcopy((long)&dirent->d_reclen, record + DIR_RECORD_FILE_SIZE, 4);
+        return 1;
+      }
+    }
+  }
+}
+
+unsigned char scan_to(unsigned short entry, long record)
+{
+  // Read entry number <entry> of the listing into record, opening the
+  // directory again and skipping entries as needed.
+  // Returns 0 if there is no such entry.
+  if (scan_open && scan_pos > entry)
+    scan_stop();
+  if (!scan_open) {
+    if (scan_complete && entry >= scan_known)
+      return 0;
+    closeall();
+    scan_dir = opendir();
+    scan_open = 1;
+    scan_pos = 0;
+  }
+
+  for (; scan_pos <= entry; scan_pos++) {
+    if (scan_pos == SCAN_MAX_ENTRIES || !scan_read(scan_pos == entry ? record : SCAN_SCRATCH_RECORD)) {
+      scan_stop();
+      scan_complete = 1;
+      scan_known = scan_pos;
+      file_count = min_dir_entry + scan_known;
+      return 0;
+    }
+  }
+  if (scan_pos > scan_known) {
+    scan_known = scan_pos;
+    file_count = min_dir_entry + scan_known;
+  }
+  return 1;
+}
+
+unsigned char dirpage_find(unsigned short page)
+{
+  unsigned char slot;
+
+  for (slot = 0; slot < DIRPAGE_SLOTS; slot++)
+    if (dirpage_page[slot] == page)
+      break;
+  return slot;
+}
+
+unsigned char dirpage_claim(unsigned short page)
+{
+  // Give page a free slot, else the least recently used one that isn't on
+  // the screen
+  unsigned char slot, victim = DIRPAGE_SLOTS;
+  short top = display_offset - min_dir_entry;
+
+  if (top < 0)
+    top = 0;
+  for (slot = 0; slot < DIRPAGE_SLOTS; slot++) {
+    if (dirpage_page[slot] == DIRPAGE_NONE)
+      break;
+    if (dirpage_page[slot] == (top >> 6) || dirpage_page[slot] == ((top + 22) >> 6))
+      continue;
+    if (victim == DIRPAGE_SLOTS || dirpage_age[slot] < dirpage_age[victim])
+      victim = slot;
+  }
+  if (slot == DIRPAGE_SLOTS) {
+    slot = victim;
+    scan_paged = 1;
+  }
+  dirpage_page[slot] = page;
+  dirpage_age[slot] = ++dirpage_clock;
+  return slot;
+}
+
+long dirpage_record(unsigned short entry)
+{
+  // Address of the record of entry, reading its page back in if need be
+  unsigned char slot, i;
+  unsigned short page = entry >> 6;
+
+  slot = dirpage_find(page);
+  if (slot == DIRPAGE_SLOTS) {
+    slot = dirpage_claim(page);
+    for (i = 0; i < DIRPAGE_ENTRIES; i++)
+      if (!scan_to((page << 6) + i, dirpage_address(slot, i)))
+        break;
+    // Nothing more to read after this, so don't hold on to the directory
+    if (scan_complete)
+      scan_stop();
+  }
+  dirpage_age[slot] = ++dirpage_clock;
+  return dirpage_address(slot, entry & (DIRPAGE_ENTRIES - 1));
+}
+
+long listing_record(short n)
+{
+  // Address of the record shown on line n
+  if (n < min_dir_entry)
+    return dir_record_address(n);
+  if (listing_sorted)
+    return dir_record(n);
+  return dirpage_record(n - min_dir_entry);
+}
+
+void draw_preview(void)
+{
+  unsigned char i;
+
+  // Title in reverse at the top, then the entries and blocks free
+  lcopy_stride((long)preview_page, SCREEN_ADDRESS + (21 * 2), PREVIEW_COLS, 2);
+  lmask(COLOUR_RAM_ADDRESS + (21 * 2) + 1, 18 * 2, 2, 0x00, 0x2e);
+  for (i = 1; i < preview_rows; i++) {
+    lcopy((long)&preview_page[i * PREVIEW_COLS], (long)entry_buffer, PREVIEW_COLS);
+    draw_directory_entry(i);
+  }
+}
+
+static unsigned short fdc_last_sector;
+
+unsigned char* fdc_block(unsigned short block)
+{
+  // Read a 256 byte block of the mounted image through the floppy controller.
+  // The image is laid out as 512 byte sectors, 10 per side, track by track.
+  unsigned short sector = block >> 1;
+
+  if (sector != fdc_last_sector) {
+    dir_track = sector / 20;
+    current_side = (sector / 10) & 1;
+    current_sector = sector % 10 + 1;
+    if (!read_sector_with_cancel()) {
+      fdc_last_sector = 0xffff;
+      return NULL;
+    }
+    // Copy the whole sector out of the floppy buffer in one go, rather than
+    // a byte at a time through $D087. Clearing $D689 bit 7 maps the floppy
+    // buffer at $FFD6E00 instead of the SD card one.
+    POKE(0xD689U, PEEK(0xD689U) & 0x7f);
+    lcopy(0xffd6e00L, (long)sector_buffer, 512);
+    POKE(0xD689U, PEEK(0xD689U) | 0x80);
+    fdc_last_sector = sector;
+  }
+  return &sector_buffer[(block & 1) << 8];
+}
+
 unsigned char draw_directory_contents(unsigned char drive_id)
 {
-  unsigned char c, i, x;
+  // Preview by mounting the image, for when we can't read it ourselves
+  unsigned char x;
   unsigned char err;
-  short skip_bytes, j;
 
   // only work on drive 0 and 1
   if (drive_id > 1)
     return 0;
 
-  lcopy(0x40000L + (selection_number * 64), (unsigned long)disk_name_return, 32);
+  lcopy(listing_record(selection_number), (unsigned long)disk_name_return, 32);
 
   // Don't draw directories
   if (disk_name_return[0] == '/')
@@ -250,12 +443,7 @@ unsigned char draw_directory_contents(unsigned char drive_id)
 
   // Try to mount it, with border black while working
   POKE(0xD020U, 0);
-  if (drive_id == 0)
-    err = mega65_dos_d81attach0(disk_name_return);
-  else if (drive_id == 1)
-    err = mega65_dos_d81attach1(disk_name_return);
-  else
-    err = 1;
+  err = attach_image(drive_id);
   if (err) {
     // Mounting the image failed
     display_error(err);
@@ -271,170 +459,18 @@ unsigned char draw_directory_contents(unsigned char drive_id)
   // d68a.6/7 -> d64 flag
   // d68b.6/7 -> d65 flag
   disk_type = ((PEEK(0xd68b) >> (5 + drive_id)) & 0x2) | ((PEEK(0xd68a) >> (6 + drive_id)) & 0x1);
-  switch (disk_type) {
-    case DISK_TYPE_D81:
-      dir_track = 39;
-      current_side = 0;
-      current_sector = 1;
-      skip_bytes = 4;
-      break;
-    case DISK_TYPE_D64:
-      dir_track = 8;
-      current_side = 1;
-      current_sector = 9;
-      skip_bytes = 256 + 0x90;
-      break;
-    case DISK_TYPE_D65:
-    case DISK_TYPE_D71:
-      // write_entry
-      return 1; // not supported
-  }
+  if (disk_type != DISK_TYPE_D81 && disk_type != DISK_TYPE_D64)
+    return 1; // not supported
 
   // Mounted disk, so now get the directory.
-
-  // Read T40 S1 (sectors begin at 1, not 0)
   POKE(0xD080U, 0x60 | drive_id); // motor and LED on, and select correct drive
   POKE(0xD081U, 0x20); // Wait for motor spin up
 
-  if (!read_sector_with_cancel())
-    goto exit_with_motor_off;
+  fdc_last_sector = 0xffff;
+  if (preview_parse(disk_type == DISK_TYPE_D81 ? PREVIEW_D81 : PREVIEW_D64, fdc_block) && !PEEK(0xD610U))
+    draw_preview();
 
-#if 0
-  // Directory sector debugger (instead of entry renderer)
-  // displays sequential 256 byte dir sectors
-  // press q to exit, any other key advances one sector
-  // display below is track/side/sector/block
-  {
-    unsigned char block;
-    while (1) {
-      block = 1;
-      while (block < 3) {
-        x = 0;
-        do {
-          c = PEEK(0xD087U);
-          if (c >= 'A' && c <= 'Z')
-            c &= 0x1f;
-          if (c >= 'a' && c <= 'z')
-            c &= 0x1f;
-          if (x % 16 == 0) {
-            POKE(SCREEN_ADDRESS + 21 * 2 + ((x >> 4) * 80), nybl_to_screen(x >> 4));
-            POKE(SCREEN_ADDRESS + 22 * 2 + ((x >> 4) * 80), nybl_to_screen(x));
-          }
-          POKE(SCREEN_ADDRESS + ((24 + (x%16)) * 2) + ((x >> 4) * 80), c & 0x7f);
-        } while (++x);
-        POKE(SCREEN_ADDRESS + 21 * 2 + 17 * 80, nybl_to_screen(dir_track >> 4));
-        POKE(SCREEN_ADDRESS + 22 * 2 + 17 * 80, nybl_to_screen(dir_track));
-        POKE(SCREEN_ADDRESS + 24 * 2 + 17 * 80, current_side + 0x30);
-        POKE(SCREEN_ADDRESS + 26 * 2 + 17 * 80, nybl_to_screen(current_sector >> 4));
-        POKE(SCREEN_ADDRESS + 27 * 2 + 17 * 80, nybl_to_screen(current_sector));
-        POKE(SCREEN_ADDRESS + 30 * 2 + 17 * 80, block);
-        while ((x = PEEK(0xD610U)) == 0);
-        POKE(0xD610U, 0);
-        if (x == 'q')
-          goto exit_with_motor_off;
-        block++;
-      }
-      current_sector++;
-      if (current_sector > 10) {
-        if (current_side == 1) {
-          current_side = 0;
-          dir_track++;
-        }
-        else
-          current_side = 1;
-        current_sector = 1;
-      }
-      if (!read_sector_with_cancel())
-        goto exit_with_motor_off;
-    }
-  }
-#else
-  // skip start of sector until we reach the disk title
-  for (j = 0; j < skip_bytes; j++)
-    c = PEEK(0xD087U);
-
-  // Then draw title at the top of the screen
-  POKE(SCREEN_ADDRESS + 21 * 2, '"');
-  for (x = 0; x < 16; x++) {
-    c = PEEK(0xD087U);
-    if (c >= 'A' && c <= 'Z')
-      c &= 0x1f;
-    POKE(SCREEN_ADDRESS + (22 + x) * 2, c & 0x7f);
-  }
-  POKE(SCREEN_ADDRESS + 38 * 2, '"');
-  // reverse for disk title
-  for (i = 0; i < 18; i++)
-    lpoke(COLOUR_RAM_ADDRESS + (21 * 2) + 1 + i * 2, 0x2e);
-
-  // user impatient?
-  if (PEEK(0xD610U))
-    goto exit_with_motor_off;
-
-  // move to first dir entry depending on disk_type
-  if (disk_type == DISK_TYPE_D81) {
-    // D81
-    current_sector++;
-    if (!read_sector_with_cancel())
-      goto exit_with_motor_off;
-    // Skip 1st half of sector
-    x = 0;
-    do
-      c = PEEK(0xD087U);
-    while (++x);
-    entries = 8;
-  }
-  else { // DISK_TYPE_D64
-    current_sector++;
-    if (!read_sector_with_cancel())
-      goto exit_with_motor_off;
-    entries = 8;
-  }
-  cur_row = 1; // begin drawing on row 1 of screen
-  draw_entries();
-  if (next_sector >= 254)
-    goto exit_with_motor_off;
-  do {
-    if (disk_type == DISK_TYPE_D81) {
-      current_sector++;
-      entries = 16;
-      skip_bytes = 0;
-    }
-    else { // DISK_TYPE_D64
-      // with D64 dir is normally 18/1, 18/4, 18/7, ...
-      if (next_sector < 2 || next_sector > 19) // illegal next sector, abort
-        goto exit_with_motor_off;
-      else if (next_sector == 2 && dir_track != 8) {
-        // go back to end of track 8
-        dir_track = 8;
-        current_side = 1;
-        current_sector = 10;
-        skip_bytes = 1;
-      }
-      else if (next_sector > 2) { // 2 is the next 256 bytes of this 512 byte sector!
-        // we just did read 18/1 which is 8/1/10/a, after it sector 3 is 9/0/1/a
-        // 9/0 has 10 512 bytes sectors, so we only need to calculate the sector
-        dir_track = 9;
-        current_side = 0;
-        current_sector = (next_sector - 1) / 2;
-        skip_bytes = (next_sector - 1) % 2;
-      }
-      else // we are on the right track...
-        dir_track = 0;
-    }
-    if (dir_track)
-      if (!read_sector_with_cancel())
-        goto exit_with_motor_off;
-
-    if (skip_bytes)
-      for (j = 0; j < 256; j++)
-        c = PEEK(0xD087U);
-
-    // once more, then we have the 22 entries we can display
-    draw_entries();
-  } while (cur_row < 23 && next_sector < 254);
-#endif
   // Turn floppy LED and motor back off
-exit_with_motor_off:
   POKE(0xD080U, 0);
   return 1;
 }
@@ -457,11 +493,10 @@ void draw_disk_image_list(void)
   lcopy(COLOUR_RAM_ADDRESS, COLOUR_RAM_ADDRESS + 4, 40 * 2 * 23 - 4);
 
   // Draw instructions
-  for (i = 0; i < 80; i++)
-    if (messed_up && i > 62)
-      POKE(SCREEN_ADDRESS + 23 * 80 + (i << 1), petscii_to_screen(diskchooser_instructions[i + 17]));
-    else
-      POKE(SCREEN_ADDRESS + 23 * 80 + (i << 1), petscii_to_screen(diskchooser_instructions[i]));
+  lcopy_stride((long)diskchooser_instructions, SCREEN_ADDRESS + 23 * 80, DISKCHOOSER_INSTRUCTIONS_ROWS * 40, 2);
+  if (messed_up)
+    lcopy_stride((long)diskchooser_unmount, SCREEN_ADDRESS + 23 * 80 + (80 - DISKCHOOSER_UNMOUNT_LEN) * 2,
+        DISKCHOOSER_UNMOUNT_LEN, 2);
 
   lcopy((long)highlight_row, COLOUR_RAM_ADDRESS + (23 * 80) + 0, 4);
   lcopy(COLOUR_RAM_ADDRESS + (23 * 80), COLOUR_RAM_ADDRESS + (23 * 80) + 4, 156);
@@ -469,7 +504,7 @@ void draw_disk_image_list(void)
   for (i = 0; i < 23; i++) {
     if ((display_offset + i) < file_count) {
       // Real line
-      lcopy(0x40000U + ((display_offset + i) << 6), (unsigned long)name, 64);
+      lcopy(listing_record(display_offset + i), (unsigned long)name, 64);
 
       for (x = 0; x < 20; x++) {
         if ((name[x] >= 'A' && name[x] <= 'Z') || (name[x] >= 'a' && name[x] <= 'z'))
@@ -500,83 +535,285 @@ void draw_disk_image_list(void)
   }
 }
 
+// Type-ahead search: typed characters build up a prefix, and the selection
+// jumps to the first entry starting with it (ignoring the '/' of directories,
+// and case). As the listing is sorted, a longer prefix can only match at or
+// after the current match, and the first character is looked up in a jump
+// index built over the listing the first time it is needed.
+#define SEARCH_MAX_LEN 16
+static char search_prefix[SEARCH_MAX_LEN];
+static unsigned char search_len = 0;
+static unsigned char search_jump_valid = 0;
+static short search_jump[0x40]; // first line for each character $20-$5F, or -1
+
+unsigned char search_fold(unsigned char c)
+{
+  if (c >= 'a' && c <= 'z')
+    return c - 0x20;
+  return c;
+}
+
+void search_build_jump_index(void)
+{
+  short n;
+  unsigned char c;
+
+  for (c = 0; c < 0x40; c++)
+    search_jump[c] = -1;
+  for (n = file_count - 1; n >= min_dir_entry; n--) {
+    lcopy(dir_record(n), (long)lburst_buffer, 2);
+    c = search_fold(lburst_buffer[lburst_buffer[0] == '/']);
+    if (c >= 0x20 && c < 0x60)
+      search_jump[c - 0x20] = n;
+  }
+  search_jump_valid = 1;
+}
+
+short search_find(short n)
+{
+  // First line from n onwards that starts with the search prefix, or -1
+  unsigned char i, skip;
+
+  for (; n < file_count; n++) {
+    lcopy(dir_record(n), (long)lburst_buffer, search_len + 1);
+    skip = lburst_buffer[0] == '/';
+    for (i = 0; i < search_len; i++)
+      if (search_fold(lburst_buffer[skip + i]) != search_prefix[i])
+        break;
+    if (i == search_len)
+      return n;
+  }
+  return -1;
+}
+
+void search_type(unsigned char c)
+{
+  // Add c to the search prefix, and select the first match.
+  // Characters that don't match anything are dropped.
+  short n;
+
+  c = search_fold(c);
+  if (!listing_sorted || search_len == SEARCH_MAX_LEN || c < 0x20 || c >= 0x60)
+    return;
+  search_prefix[search_len++] = c;
+
+  if (search_len == 1) {
+    if (!search_jump_valid)
+      search_build_jump_index();
+    n = search_jump[c - 0x20];
+  }
+  else
+    n = search_find(selection_number);
+
+  if (n < 0)
+    search_len--;
+  else
+    selection_number = n;
+}
+
+void scan_finish(void)
+{
+  // The whole directory has been read. If it fitted, sort it (directories
+  // first, then names, but ".." stays at the top) and cache it.
+  short record = selection_number;
+
+  if (scan_paged)
+    return;
+  dirlist_reset(file_count);
+  dirlist_sort(min_dir_entry, file_count - min_dir_entry);
+  dircache_store(DIRCACHE_DISK_IMAGES, min_dir_entry - not_in_root, file_count - min_dir_entry + not_in_root, not_in_root);
+  listing_sorted = 1;
+
+  // Stay on the same entry
+  if (record >= min_dir_entry)
+    for (selection_number = min_dir_entry; dirlist_index[selection_number] != record; selection_number++)
+      continue;
+}
+
+unsigned char scan_job(void)
+{
+  // Read the next entry of the directory
+  unsigned char slot;
+
+  slot = dirpage_find(scan_known >> 6);
+  if (slot == DIRPAGE_SLOTS && (scan_known & (DIRPAGE_ENTRIES - 1)))
+    // Part of a page that has had to make way: read it in again
+    dirpage_record(scan_known);
+  else {
+    if (slot == DIRPAGE_SLOTS)
+      slot = dirpage_claim(scan_known >> 6);
+    scan_to(scan_known, dirpage_address(slot, scan_known & (DIRPAGE_ENTRIES - 1)));
+  }
+
+  if (file_count <= display_offset + 23)
+    listing_dirty = 1;
+  if (!scan_complete)
+    return SCHED_MORE;
+  scan_finish();
+  listing_dirty = 1;
+  return SCHED_DONE;
+}
+
 void scan_directory(unsigned char drive_id)
 {
-  unsigned char x, dir;
-  char* ptr;
-  struct m65_dirent* dirent;
+  unsigned char slot;
 
+  PROF_BEGIN(PROF_SCAN_DIRECTORY);
   file_count = 0;
+  search_len = 0;
+  search_jump_valid = 0;
 
+  sched_cancel(scan_job);
   closeall();
+  scan_open = 0;
 
   // Add the pseudo disks
-  lcopy((unsigned long)"- NO DISK -         ", 0x40000L + (file_count * 64), 20);
+  lcopy((unsigned long)"- NO DISK -         ", dir_record_address(file_count), 20);
   file_count++;
   if (drive_id == 0) {
-    lcopy((unsigned long)INTERNAL_DRIVE_0, 0x40000L + (file_count * 64), 20);
+    lcopy((unsigned long)INTERNAL_DRIVE_0, dir_record_address(file_count), 20);
     file_count++;
   }
   else if (drive_id == 1) {
-    lcopy((unsigned long)INTERNAL_DRIVE_1, 0x40000L + (file_count * 64), 20);
+    lcopy((unsigned long)INTERNAL_DRIVE_1, dir_record_address(file_count), 20);
     file_count++;
   }
-  lcopy((unsigned long)"- NEW D81 DD IMAGE -", 0x40000L + (file_count * 64), 20);
+  lcopy((unsigned long)"- NEW D81 DD IMAGE -", dir_record_address(file_count), 20);
   file_count++;
 
 #if 0
-  lcopy((unsigned long)"- NEW D65 HD IMAGE -", 0x40000L + (file_count * 64), 20);
+  lcopy((unsigned long)"- NEW D65 HD IMAGE -", dir_record_address(file_count), 20);
   file_count++;
 #endif
 
   min_dir_entry = file_count;
+  scan_complete = 1;
+  listing_sorted = 1;
+
+  // Been here before? (not_in_root is stored as the flags, and the records
+  // start where ".." would have gone)
+  slot = dircache_lookup(DIRCACHE_DISK_IMAGES);
+  if (slot != DIRCACHE_MISS) {
+    not_in_root = dircache_flags;
+    file_count = min_dir_entry - not_in_root;
+    dirlist_reset(file_count);
+    dircache_load(slot, file_count);
+    file_count += dircache_count;
+    PROF_END(PROF_SCAN_DIRECTORY);
+    return;
+  }
 
   not_in_root = 0;
-  dir = opendir();
-  dirent = readdir(dir);
-  while (dirent && ((unsigned short)dirent != 0xffffU)) {
+  scan_complete = 0;
+  scan_paged = 0;
+  listing_sorted = 0;
+  scan_known = 0;
+  for (slot = 0; slot < DIRPAGE_SLOTS; slot++)
+    dirpage_page[slot] = DIRPAGE_NONE;
+
+  // Read the first screenful now, and the rest in the background
+  dirpage_claim(0);
+  while (!scan_complete && scan_known < 23)
+    scan_to(scan_known, dirpage_address(0, scan_known));
+  if (scan_complete)
+    scan_finish();
+  else
+    sched_add(scan_job);
+  PROF_END(PROF_SCAN_DIRECTORY);
+}
 
-    x = strlen(dirent->d_name);
+// Directory preview of the selected image, after sitting idle for about a
+// second, so that scrolling through the list doesn't read every image passed
+#define PREVIEW_IDLE_FRAMES 50
+// The type-ahead search ends after about a second
+#define SEARCH_IDLE_FRAMES 50
+static unsigned char preview_drive_id;
 
-    // check DIR attribute of dirent
-    if (dirent->d_type & 0x10) {
-      // if there is a .. path, then we are in a subdir
-      if (!strcmp("..", dirent->d_name)) {
-        not_in_root = 1;
-        file_count--; // overwrite makedisk
-      }
-      if (x < 60) {
-        lfill(0x40000L + (file_count * 64), ' ', 64);
-        lcopy((long)&dirent->d_name[0], 0x40000L + 1 + (file_count * 64), x);
-        // Put / at the start of directory names to make them obviously different
-        lpoke(0x40000L + (file_count * 64), '/');
-        // Don't list "." directory pointer
-        if (strcmp(".", dirent->d_name))
-          file_count++;
-      }
-    }
-    else if (x > 4) {
-      ptr = &dirent->d_name[x - 4];
-      if ((!strcmp(ptr, ".D81")) || (!strcmp(ptr, ".d81")) || (!strcmp(ptr, ".D64")) || (!strcmp(ptr, ".d64"))
-          || (!strcmp(ptr, ".D65")) || (!strcmp(ptr, ".d65"))) {
-        // File is a disk image
-        lfill(0x40000L + (file_count * 64), ' ', 64);
-        lcopy((long)&dirent->d_name[0], 0x40000L + (file_count * 64), x);
-        file_count++;
-      }
-    }
+static uint32_t selected_cluster, selected_size;
 
-    dirent = readdir(dir);
-  }
+unsigned char selected_image(void)
+{
+  // Get the start cluster and size of the selected disk image, if it is one
+  if (selection_number < min_dir_entry)
+    return 0;
+  lcopy(listing_record(selection_number), (long)lburst_buffer, DIR_RECORD_SIZE);
+  if (lburst_buffer[0] == '/')
+    return 0;
+  selected_cluster = *(uint32_t*)&lburst_buffer[DIR_RECORD_CLUSTER];
+  selected_size = *(uint32_t*)&lburst_buffer[DIR_RECORD_FILE_SIZE];
+  return 1;
+}
 
-  closedir(dir);
+void draw_cached_preview(void)
+{
+  // If we have seen the selected image before, show its preview straight away
+  if (selected_image() && preview_lookup(selected_cluster, selected_size))
+    draw_preview();
+}
+
+unsigned char preview_job(void)
+{
+  if (!selected_image())
+    return SCHED_DONE;
+
+  // Read the directory straight out of the image if we can, else mount it
+  if (preview_render(selected_cluster, selected_size))
+    draw_preview();
+  else if (draw_directory_contents(preview_drive_id))
+    messed_up = 1; // function did mount an image, so we need to return empty if aborted
+  return SCHED_DONE;
+}
+
+char defrag_selected(unsigned char drive_id, char err)
+{
+  // Offer to make a fragmented image contiguous, and if that works, try
+  // mounting it again
+  unsigned char x;
+
+  if (!selected_image())
+    return err;
+  display_message("FRAGMENTED: FIX Y/N", error_row);
+  while (!(x = PEEK(0xD610U)))
+    continue;
+  POKE(0xD610U, 0);
+  if ((x | 0x20) != 'y')
+    return err;
+
+  display_message("MAKING CONTIGUOUS", normal_row);
+  err = defrag_image(selected_cluster, selected_size);
+  if (err)
+    return err;
+  // The image has moved, so keep the listing (and the preview cache) up to date
+  lcopy((long)&defrag_cluster, listing_record(selection_number) + DIR_RECORD_CLUSTER, 4);
+  POKE(0xD020U, 0);
+  return attach_image(drive_id);
+}
+
+void scan_cancel(void)
+{
+  // Leaving: don't carry on reading the directory behind the freezer's back
+  sched_cancel(scan_job);
+  scan_stop();
+}
+
+void scroll_to_selection(void)
+{
+  // Adjust display position
+  if (selection_number < display_offset)
+    display_offset = selection_number;
+  if (selection_number > (display_offset + 22))
+    display_offset = selection_number - 22;
+  if (display_offset > (file_count - 22))
+    display_offset = file_count - 22;
+  if (display_offset < 0)
+    display_offset = 0;
 }
 
 char* freeze_select_disk_image(unsigned char drive_id)
 {
   unsigned char x;
   char err;
-  int idle_time = 0;
+  unsigned char idle_frames = 0;
 
   // if working with drive 1, we will be
   if (drive_id == 1) {
@@ -587,6 +824,11 @@ char* freeze_select_disk_image(unsigned char drive_id)
   selection_number = 0;
   display_offset = 0;
 
+  // Drop anything the freezer had running in the background, as it may be
+  // using the memory we are about to list the directory into
+  sched_init();
+  preview_drive_id = drive_id;
+
   // First, clear the screen
   POKE(SCREEN_ADDRESS + 0, ' ');
   POKE(SCREEN_ADDRESS + 1, 0);
@@ -594,8 +836,7 @@ char* freeze_select_disk_image(unsigned char drive_id)
   POKE(SCREEN_ADDRESS + 3, 0);
   lcopy(SCREEN_ADDRESS, SCREEN_ADDRESS + 4, 40 * 2 * 25 - 4);
 
-  for (x = 0; reading_disk_list_message[x]; x++)
-    POKE(SCREEN_ADDRESS + 12 * 40 * 2 + (9 * 2) + (x * 2), reading_disk_list_message[x] & 0x3f);
+  lcopy_stride((long)reading_disk_list_message, SCREEN_ADDRESS + 12 * 40 * 2 + (9 * 2), READING_DISK_LIST_MESSAGE_LEN, 2);
 
   scan_directory(drive_id);
 
@@ -606,6 +847,13 @@ char* freeze_select_disk_image(unsigned char drive_id)
   // Okay, we have some disk images, now get the user to pick one!
   draw_disk_image_list();
   while (1) {
+    sched_run();
+    if (listing_dirty) {
+      listing_dirty = 0;
+      scroll_to_selection();
+      draw_disk_image_list();
+      draw_cached_preview();
+    }
     x = PEEK(0xD610U);
 
     if (!x) {
@@ -617,17 +865,19 @@ char* freeze_select_disk_image(unsigned char drive_id)
     }
 
     if (!x) {
-      idle_time++;
-      if (idle_time == 100 && selection_number >= min_dir_entry) {
-        // After sitting idle for 1 second, try mounting disk image and displaying directory listing
-        if (draw_directory_contents(drive_id))
-          messed_up = 1; // function did mount an image, so we need to return empty if aborted
+      // After sitting idle, display the directory of the disk image,
+      // and a while later end the type-ahead search
+      if (idle_frames < SEARCH_IDLE_FRAMES) {
+        idle_frames++;
+        if (idle_frames == PREVIEW_IDLE_FRAMES && selection_number >= min_dir_entry && scan_complete)
+          sched_add(preview_job);
+        if (idle_frames == SEARCH_IDLE_FRAMES)
+          search_len = 0;
       }
-      usleep(10000);
       continue;
     }
-    else
-      idle_time = 0;
+    idle_frames = 0;
+    sched_cancel(preview_job);
 
     // Clear read key
     POKE(0xD610U, 0);
@@ -635,23 +885,26 @@ char* freeze_select_disk_image(unsigned char drive_id)
     switch (x) {
     case 0x5f: // <- key at top left of key board
       // Go back up one directory
+      scan_stop();
       mega65_dos_chdir((unsigned char *)"..");
       file_count = 0;
       selection_number = 0;
       display_offset = 0;
       scan_directory(drive_id);
-      draw_disk_image_list();
-
       break;
     case 0x03: // RUN-STOP = make no change, but only if we did not mess up the drive!
-      if (!messed_up)
+      if (!messed_up) {
+        scan_cancel();
         return NULL;
+      }
       selection_number = 0; // select no disk entry
       // fall though!
     case 0x0d:
     case 0x21: // Return = select this disk.
+      // (Let go of the directory first, we will open it again if we stay)
+      scan_stop();
       // Copy name out
-      lcopy(0x40000L + (selection_number * 64), (unsigned long)disk_name_return, 32);
+      lcopy(listing_record(selection_number), (unsigned long)disk_name_return, 32);
       // Then null terminate it
       for (x = 31; x; x--)
         if (disk_name_return[x] == ' ') {
@@ -680,7 +933,6 @@ char* freeze_select_disk_image(unsigned char drive_id)
         selection_number = 0;
         display_offset = 0;
         scan_directory(drive_id);
-        draw_disk_image_list();
       }
       else {
         if (disk_name_return[0] == '-') {
@@ -721,18 +973,10 @@ char* freeze_select_disk_image(unsigned char drive_id)
           }
         }
         else {
-          if (drive_id == 0) {
-            // hyppo attach does this
-            // lpoke(0xffd368bL, (lpeek(0xffd368bL) & 0xb8) + 0x07);
-            err = mega65_dos_d81attach0(disk_name_return);
-          }
-          else if (drive_id == 1) {
-            // hyppo attach does this
-            // lpoke(0xffd368bL, (lpeek(0xffd368bL) & 0x47) + 0x38);
-            err = mega65_dos_d81attach1(disk_name_return);
-          }
-          else
-            err = -1;
+          err = attach_image(drive_id);
+          // The hypervisor can only mount images that are in one piece
+          if (err == 0x8b)
+            err = defrag_selected(drive_id, err);
           if (err) {
             // Mounting the image failed
             display_error(err);
@@ -779,36 +1023,34 @@ char* freeze_select_disk_image(unsigned char drive_id)
         }
 
         // Mounted ok, so return this image
+        scan_cancel();
         return disk_name_return;
       }
       break;
     case 0x11:
     case 0x9d: // Cursor down or left
+      search_len = 0;
       POKE(0xD020U, 6);
       selection_number++;
       if (selection_number >= file_count)
-        selection_number = 0;
+        selection_number = scan_complete ? 0 : file_count - 1;
       break;
     case 0x91:
     case 0x1d: // Cursor up or right
+      search_len = 0;
       POKE(0xD020U, 6);
       selection_number--;
       if (selection_number < 0)
         selection_number = file_count - 1;
       break;
+    default: // Anything else is the next character of a type-ahead search
+      search_type(x);
+      break;
     }
 
-    // Adjust display position
-    if (selection_number < display_offset)
-      display_offset = selection_number;
-    if (selection_number > (display_offset + 22))
-      display_offset = selection_number - 22;
-    if (display_offset > (file_count - 22))
-      display_offset = file_count - 22;
-    if (display_offset < 0)
-      display_offset = 0;
-
+    scroll_to_selection();
     draw_disk_image_list();
+    draw_cached_preview();
   }
 
   return NULL;
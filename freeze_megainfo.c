@@ -9,6 +9,8 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_file.h"
+#include "freezer_handoff.h"
 #include "ascii.h"
 
 /*
@@ -58,9 +60,10 @@ void write_text(unsigned char x, unsigned char y, unsigned short colour, char* t
       c = 94;
     if (colour & 0x100 && c < 128)
       c |= 0x80;
-    lpoke(SCREEN_ADDRESS + y * 80 + x + i, c);
-    lpoke(COLOUR_RAM_ADDRESS + y * 80 + x + i, (unsigned char)(colour & 0xff));
+    lburst_buffer[i] = c;
   }
+  lburst_write(SCREEN_ADDRESS + y * 80 + x, i);
+  lfill(COLOUR_RAM_ADDRESS + y * 80 + x, (unsigned char)(colour & 0xff), i);
 }
 
 /*
@@ -86,9 +89,10 @@ void write_text_upper(unsigned char x, unsigned char y, unsigned short colour, c
       c = 94;
     if (colour & 0x100 && c < 128)
       c |= 0x80;
-    lpoke(SCREEN_ADDRESS + y * 80 + x + i, c);
-    lpoke(COLOUR_RAM_ADDRESS + y * 80 + x + i, (unsigned char)(colour & 0xff));
+    lburst_buffer[i] = c;
   }
+  lburst_write(SCREEN_ADDRESS + y * 80 + x, i);
+  lfill(COLOUR_RAM_ADDRESS + y * 80 + x, (unsigned char)(colour & 0xff), i);
 }
 
 /*
@@ -266,9 +270,15 @@ char* format_fpga_hash(unsigned char offset, unsigned char reverse)
 char* format_rom_version(void)
 {
   // we want to display the version in freeze slot 0!
-  find_freeze_slot_start_sector(0);
-  freeze_slot_start_sector = *(uint32_t*)0xD681U;
-  request_freeze_region_list();
+  // (the freezer will usually have told us already)
+  if (handoff_valid & HANDOFF_ROM)
+    return mega65_rom_name;
+  if (!(handoff_valid & HANDOFF_SLOT)) {
+    find_freeze_slot_start_sector(0);
+    freeze_slot_start_sector = *(uint32_t*)0xD681U;
+    request_freeze_region_list();
+  }
+  handoff_valid |= HANDOFF_SLOT | HANDOFF_ROM;
 
   return detect_rom();
 }
@@ -777,9 +787,12 @@ void draw_screen(void)
 
   // check for HICKUP
   write_text(40, 9, 1, "HYPPO STATUS:");
-  if (read_file_from_sdcard("HICKUP.M65", 0x40000L))
+  if (file_open("HICKUP.M65"))
     write_text(54, 9, 7, "NORMAL");
   else {
+    // (the version is in the first 32KB)
+    file_read(0x40000L, 0x8000U);
+    file_close();
     fail = format_hickup_version(0x40000L, artix_ymd);
     write_text_upper(41, 10, 7 + fail * 3, buffer);
     if (fail)
@@ -792,11 +805,11 @@ void draw_screen(void)
   write_text(0, 10, 1, "ROM VERSION:");
   write_text(15, 10, 7, format_rom_version());
 
-  // Utility versions (need to load file to parse...)
+  // Utility versions (from the first sector of each file)
   row = 12;
   col = 0;
   for (i = 0; SDessentials[i][0] != 0; i++) {
-    fail = read_file_from_sdcard(SDessentials[i], 0x40000L);
+    fail = !file_load(SDessentials[i], 0, 0x40000L, 512);
     strcpy(buffer, SDessentials[i]);
     strcat(buffer, ":");
     write_text(col, row, 1, buffer);
@@ -7,6 +7,9 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_prof.h"
+#include "freezer_dirlist.h"
+#include "freezer_dircache.h"
 #include "ascii.h"
 
 short file_count = 0;
@@ -157,7 +160,7 @@ void draw_file_list(void)
   for (i = 0; i < 23; i++) {
     if ((display_offset + i) < file_count) {
       // Real line
-      lcopy(0x40000U + ((display_offset + i) << 6), (unsigned long)name, 64);
+      lcopy(dir_record(display_offset + i), (unsigned long)name, 64);
 
       for (x = 0; x < 32; x++) {
         if ((name[x] >= 'A' && name[x] <= 'Z') || (name[x] >= 'a' && name[x] <= 'z'))
@@ -186,16 +189,28 @@ void draw_file_list(void)
 void scan_directory(void)
 {
   unsigned char x, dir;
-  short last_dir = -1, dir_pos, i;
+  char prefix[6];
+  unsigned short i, record;
   struct m65_dirent* dirent;
 
+  PROF_BEGIN(PROF_SCAN_DIRECTORY);
   file_count = 0;
 
+  // Been here before?
+  x = dircache_lookup(DIRCACHE_ROMS);
+  if (x != DIRCACHE_MISS) {
+    dircache_load(x, 0);
+    file_count = dircache_count;
+    PROF_END(PROF_SCAN_DIRECTORY);
+    return;
+  }
+
   closeall();
 
   dir = opendir();
   dirent = readdir(dir);
-  while (dirent && ((unsigned short)dirent != 0xffffU)) {
+  // (only as many entries as fit, see DIRLIST_MAX_ENTRIES)
+  while (dirent && ((unsigned short)dirent != 0xffffU) && file_count < DIRLIST_MAX_ENTRIES) {
 
     x = strlen(dirent->d_name);
     // only accept 32 characters max!
@@ -207,21 +222,10 @@ void scan_directory(void)
       // File is a directory
       // limit filename length and skip '.' directory
       if (strcmp(dirent->d_name, ".")) {
-        // keep directories at the top, and
-        // always put ROMS dir at the very top
-        if (!strcmp(dirent->d_name, "ROMS"))
-          dir_pos = 0;
-        else
-          dir_pos = last_dir + 1;
-        if (file_count && dir_pos != file_count) {
-          for (i = file_count - 1; i >= dir_pos; i--)
-            lcopy(0x40000L + (i * 64), 0x40040L + (i * 64), 64); // can't reverse copy!
-        }
-        lfill(0x40000L + (dir_pos * 64), ' ', 64);
-        lcopy((long)&dirent->d_name[0], 0x40000L + 1 + (dir_pos * 64), x);
+        lfill(dir_record_address(file_count), ' ', 64);
+        lcopy((long)&dirent->d_name[0], dir_record_address(file_count) + 1, x);
         // Put / at the start of directory names to make them obviously different
-        lpoke(0x40000L + (dir_pos * 64), '/');
-        last_dir++;
+        lpoke(dir_record_address(file_count), '/');
         file_count++;
       }
     }
@@ -235,8 +239,8 @@ void scan_directory(void)
               (!strncmp(&dirent->d_name[x - 4], ".chr", 4)) ||    // 8x8 CHaRacter Set FONT files
               (!strncmp(&dirent->d_name[x - 4], ".tcr", 4)))) {   // 8x16 Tall ChaRacter Set FONT files
       // File is a ROM or a CHaRset
-      lfill(0x40000L + (file_count * 64), ' ', 64);
-      lcopy((long)&dirent->d_name[0], 0x40000L + (file_count * 64), x);
+      lfill(dir_record_address(file_count), ' ', 64);
+      lcopy((long)&dirent->d_name[0], dir_record_address(file_count), x);
       file_count++;
     }
 
@@ -245,6 +249,24 @@ next_entry:
   }
 
   closedir(dir);
+
+  // keep directories at the top, and
+  // always put ROMS dir at the very top
+  dirlist_reset(file_count);
+  dirlist_sort(0, file_count);
+  for (i = 0; i < file_count; i++) {
+    lcopy(dir_record(i), (long)prefix, 6);
+    if (!strncmp(prefix, "/ROMS ", 6)) {
+      record = dirlist_index[i];
+      for (; i; i--)
+        dirlist_index[i] = dirlist_index[i - 1];
+      dirlist_index[0] = record;
+      break;
+    }
+  }
+
+  dircache_store(DIRCACHE_ROMS, 0, file_count, 0);
+  PROF_END(PROF_SCAN_DIRECTORY);
 }
 
 /*
@@ -315,7 +337,7 @@ unsigned char freeze_load_romarea(void)
     case 0x0d:
     case 0x21: // Return = select this file.
       // Copy name out
-      lcopy(0x40000L + (selection_number * 64), (unsigned long)rom_name_return, 32);
+      lcopy(dir_record(selection_number), (unsigned long)rom_name_return, 32);
       // Then null terminate it
       for (x = 31; x; x--)
         if (rom_name_return[x] == ' ') {
@@ -74,6 +74,7 @@
 #include <stdlib.h>
 #include <memory.h>
 #include "freezer.h"
+#include "freezer_handoff.h"
 
 extern int errno;
 //#define SPRITED_STANDALONE
@@ -333,10 +334,13 @@ static void Initialize()
 
   // --- Freezer slot setup
 
-  find_freeze_slot_start_sector(0);
-  freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  if (!(handoff_valid & HANDOFF_SLOT)) {
+    find_freeze_slot_start_sector(0);
+    freeze_slot_start_sector = *(uint32_t*)0xD681U;
 
-  request_freeze_region_list();
+    request_freeze_region_list();
+  }
+  handoff_valid |= HANDOFF_SLOT;
 
   // --- Screen setup ----
 
@@ -12,62 +12,36 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
-
-unsigned char* freeze_menu_bar = (unsigned char *)
-                             "F3-RESUME    F5-RESET      HELP-MEGAINFO"
-                             "F3-LOAD SLOT F7-SAVE SLOT  HELP-MEGAINFO";
-
-unsigned char* freeze_menu = (unsigned char *)
-                             "        MEGA65 FREEZE MENU V0.3.0       "
-                             "  (C) MUSEUM OF ELECTRONIC GAMES & ART  "
-                             "cccccccccccccccccccccccccccccccccccccccc"
+#include "freezer_compose.h"
+#include "freezer_sched.h"
+#include "freezer_prof.h"
+#include "freezer_dirlist.h"
+#include "freezer_file.h"
+#include "freezer_stat.h"
+#include "freezer_toolcache.h"
+#include "freezer_handoff.h"
+#include "freezer_tpl.h"
+
+// The menu screens themselves live in templates/freezer.tpl.
+// These are the positions of the fields we fill in at run time.
 #define LOAD_RESUME_OFFSET (3 * 40)
-                             "F3-RESUME    F5-RESET      HELP-MEGAINFO"
-                             "cccccccccccccccccccccccccccccccccccccccc"
 #define CPU_MODE_OFFSET (5 * 40 + 13)
 #define JOY_SWAP_OFFSET (5 * 40 + 36)
-                             " (C)PU MODE:   4510  (J)OY SWAP:    YES "
 #define CPU_FREQ_OFFSET (6 * 40 + 13)
 #define CART_ENABLE_OFFSET (6 * 40 + 36)
-                             " CPU (F)REQ: 40 MHZ  CAR(T) ENABLE: YES "
 // #define ROM_NAME_OFFSET (7 * 40 + 8)
 #define CRTEMU_MODE_OFFSET (7 * 40 + 16)
 #define VIDEO_MODE_OFFSET (7 * 40 + 33)
-                             " C(R)T EMU:     OFF  (V)IDEO:    NTSC60 "
-                             "cccccccccccccccccccccccccccccccccccccccc"
-#define TOOLS_MENU_OFFSET (9 * 40)
-                             " M - MONITOR         L - LOAD ROM/CHAR  "
-                             " A - AUDIO & VOLUME                     "
-                             " S - SPRITE EDITOR   HELP - MEGAINFO    "
-                             "cccccccccccccccccccccccccccccccccccccccc"
-                             "~~~~~~~~~~~~~~~~~~~~                    "
+#define TOOLS_MENU_ROW 9
 #define PROCESS_NAME_OFFSET (14 * 40 + 21)
-                             "~~~~~~~~~~~~~~~~~~~~                    "
 #define PROCESS_ROM_OFFSET (15 * 40 + 26)
-                             "~~~~~~~~~~~~~~~~~~~~ ROM:               "
 #define PROCESS_ID_OFFSET (16 * 40 + 34)
 #define SLOT_NUMBER_OFFSET (17 * 40 + 34)
-                             "~~~~~~~~~~~~~~~~~~~~ TASK ID:           "
 #define FREEZE_SLOT_OFFSET (17 * 40 + 20)
-                             "~~~~~~~~~~~~~~~~~~~~ FREEZE SLOT:       "
-                             "~~~~~~~~~~~~~~~~~~~~                    "
-
-                             "~~~~~~~~~~~~~~~~~~~~ (0) INTERNAL DRIVE:"
 #define DRIVE0_NUM_OFFSET (20 * 40 + 35)
-                             "~~~~~~~~~~~~~~~~~~~~     (8) UNIT #     "
 #define D81_IMAGE0_NAME_OFFSET (21 * 40 + 22)
-                             "~~~~~~~~~~~~~~~~~~~~                    "
-                             "~~~~~~~~~~~~~~~~~~~~ (1) EXTERNAL 1565: "
 #define DRIVE1_NUM_OFFSET (23 * 40 + 35)
-                             "~~~~~~~~~~~~~~~~~~~~     (9) UNIT #     "
 #define D81_IMAGE1_NAME_OFFSET (24 * 40 + 22)
-                             "~~~~~~~~~~~~~~~~~~~~                    "
-                             "\0";
-unsigned char* freeze_root_warn = (unsigned char *)
-                             " NEED TO CHANGE CURRENT DIR TO ROOT TO  "
-                             " START TOOL! THIS WILL BREAK DISK IMAGE "
-                             " MOUNTS FROM SUBDIRS!    PROCEED (Y/N)? "
-                             "\0";
 
 // name of the file that is loaded by charset restore F14
 #define DEFAULT_CHARSET "CHARSET.M65"
@@ -203,8 +177,10 @@ unsigned char next_cpu_speed(void)
 }
 
 unsigned char thumbnail_buffer[4096];
+static unsigned char thumbnail_step;
+static uint32_t thumbnail_sector;
 
-void draw_thumbnail(void)
+unsigned char thumbnail_job(void)
 {
   // Take the 4K of thumbnail data and render it to the display
   // area at $50000.
@@ -216,37 +192,47 @@ void draw_thumbnail(void)
   // process the 8 sectors of data in a linear fashion.
   // The thumbnail bytes themselves are arranged linearly, so we
   // have to work out the right place to store them in the thumbnail
-  // data.  We would really like to avoid having to use lpoke for
-  // this all the time, because lpoke() uses a DMA for every memory
-  // access, which really slows things down. This would be bad, since
-  // we want users to be able to very quickly and smoothly flip between
-  // the freeze slots and see what is there.
-  // But there isn't currently a good solution to this, short of having
-  // a second buffer into which to render it.
-  unsigned char x, y, i;
+  // data.
+  // This runs as a background job, one sector per slice, so that users
+  // can still very quickly and smoothly flip between the freeze slots
+  // and see what is there. Changing slot just restarts it.
+  unsigned char x, y;
   unsigned short yoffset, yoffset_out, xoffset, j;
-  uint32_t thumbnail_sector = find_thumbnail_offset();
 
-  // Can't find thumbnail area?  Then show no thumbnail
-  if (thumbnail_sector == 0xFFFFFFFFUL) {
-    lfill(0x50000L, 0, 10 * 6 * 64);
-    return;
+  PROF_BEGIN(PROF_THUMBNAIL);
+  if (!thumbnail_step) {
+    thumbnail_sector = find_thumbnail_offset();
+
+    // Can't find thumbnail area?  Then show no thumbnail
+    if (thumbnail_sector == 0xFFFFFFFFUL) {
+      lfill(0x50000L, 0, 10 * 6 * 64);
+      PROF_END(PROF_THUMBNAIL);
+      return SCHED_DONE;
+    }
   }
+
   // Copy thumbnail memory to buffer
-  for (i = 0; i < 8; i++) {
-    sdcard_readsector(freeze_slot_start_sector + thumbnail_sector + i);
-    lcopy((long)sector_buffer, (long)thumbnail_buffer + (i * 0x200), 0x200);
-    NAVIGATION_KEY_CHECK();
+  if (thumbnail_step < 8) {
+    sdcard_readsector(freeze_slot_start_sector + thumbnail_sector + thumbnail_step);
+    lcopy((long)sector_buffer, (long)thumbnail_buffer + (thumbnail_step * 0x200), 0x200);
+    thumbnail_step++;
+    PROF_END(PROF_THUMBNAIL);
+    return SCHED_MORE;
   }
 
-  // Pick colours of all pixels in the thumbnail
-  for (j = 0; j < 4096; j++)
-    thumbnail_buffer[j] = colour_table[thumbnail_buffer[j]];
-  // Fix column 0 of pixels
-  yoffset = 0;
-  for (j = 0; j < 49; j++) {
-    thumbnail_buffer[yoffset] = thumbnail_buffer[yoffset + 1];
-    yoffset += 80;
+  if (thumbnail_step == 8) {
+    // Pick colours of all pixels in the thumbnail
+    for (j = 0; j < 4096; j++)
+      thumbnail_buffer[j] = colour_table[thumbnail_buffer[j]];
+    // Fix column 0 of pixels
+    yoffset = 0;
+    for (j = 0; j < 49; j++) {
+      thumbnail_buffer[yoffset] = thumbnail_buffer[yoffset + 1];
+      yoffset += 80;
+    }
+    thumbnail_step++;
+    PROF_END(PROF_THUMBNAIL);
+    return SCHED_MORE;
   }
 
   // Rearrange pixels
@@ -266,9 +252,17 @@ void draw_thumbnail(void)
 
       xoffset += 64 * 6;
     }
-    NAVIGATION_KEY_CHECK();
     yoffset += 80;
   }
+  PROF_END(PROF_THUMBNAIL);
+  return SCHED_DONE;
+}
+
+void draw_thumbnail(void)
+{
+  // (Re)start loading the thumbnail of the current slot
+  thumbnail_step = 0;
+  sched_add(thumbnail_job);
 }
 
 struct process_descriptor_t process_descriptor;
@@ -292,23 +286,9 @@ void predraw_freeze_menu(void)
   POKE(0xD020U, 6);
   POKE(0xD021U, 6);
 
-  lfill(0xFF80000L, 1, 2000);
-  // Make disk image names different colour to avoid confusion
-  for (i = 40; i < 80; i += 2) {
-    lpoke(0xff80000 + 21 * 80 + 1 + i, 0xe);
-    lpoke(0xff80000 + 24 * 80 + 1 + i, 0xe);
-    if (i > 50) // ROM VERSION
-      lpoke(0xff80000 + 15 * 80 + 1 + i, 0xf);
-  }
-
-  // Clear 16-bit text mode screen using DMA copy to copy the
-  // manually cleared first couple of chars (we need two, because
-  // of the pipelining in the DMA engine).
-  lpoke(SCREEN_ADDRESS, 0x20);
-  lpoke(SCREEN_ADDRESS + 1, 0x00);
-  lpoke(SCREEN_ADDRESS + 2, 0x20);
-  lpoke(SCREEN_ADDRESS + 3, 0x00);
-  lcopy(SCREEN_ADDRESS, SCREEN_ADDRESS + 4, 2000 - 4);
+  // Draw the whole menu once, draw_freeze_menu() then only fills in
+  // the fields it has been asked to update.
+  compose_image(freeze_menu, freeze_menu_colour, 0, FREEZE_MENU_ROWS);
 
   last_thumb_frame = -1;
 }
@@ -325,102 +305,101 @@ void predraw_freeze_menu(void)
 #define UPDATE_CHGSLOT 0x80
 // clang-format on
 
-void copy_convert_to_screen(unsigned char *data, short offset)
+char blank_field[] = "                    ";
+char number_field[5];
+
+// Draw a number as five characters (the width that screen_decimal() produces)
+void compose_decimal(unsigned short offset, unsigned int value)
 {
-  offset <<= 1;
-
-  for (i = 0; data[i]; i++)
-    if (data[i] != '~') { // skip thumb area
-      if ((data[i] >= 'A') && (data[i] <= 'Z'))
-        POKE(SCREEN_ADDRESS + i * 2 + 0 + offset, data[i] - 0x40);
-      else if ((data[i] >= 'a') && (data[i] <= 'z'))
-        POKE(SCREEN_ADDRESS + i * 2 + 0 + offset, data[i] - 0x20);
-      else
-        POKE(SCREEN_ADDRESS + i * 2 + 0 + offset, data[i]);
-      POKE(SCREEN_ADDRESS + i * 2 + 1 + offset, 0);
-    }
+  screen_decimal((unsigned int)number_field, value);
+  compose_text(number_field, offset, 5);
 }
 
 void draw_freeze_menu(unsigned char part)
 {
   unsigned char x, y;
 
+  PROF_BEGIN(PROF_DRAW_FREEZE_MENU);
   if (part & UPDATE_CHGSLOT) {
     find_freeze_slot_start_sector(slot_number);
     freeze_slot_start_sector = *(uint32_t*)0xD681U;
     request_freeze_region_list();
+    // The ROM in the new slot still has to be found out
+    handoff_valid &= ~HANDOFF_ROM;
   }
 
   // Update messages based on the settings we allow to be easily changed
   if (part & UPDATE_TOP) {
 
     if (slot_number) {
-      lcopy((unsigned long)freeze_menu_bar + 40, (unsigned long)&freeze_menu[LOAD_RESUME_OFFSET], 40);
-      lcopy((unsigned long)" FREEZE SLOT:      ", (unsigned long)&freeze_menu[FREEZE_SLOT_OFFSET], 19);
+      compose_image(freeze_menu_bar + 40, NULL, LOAD_RESUME_OFFSET / 40, 1);
+      compose_text(" FREEZE SLOT:      ", FREEZE_SLOT_OFFSET, 19);
       // Display slot ID as decimal
-      screen_decimal((unsigned long)&freeze_menu[SLOT_NUMBER_OFFSET], slot_number);
+      compose_decimal(SLOT_NUMBER_OFFSET, slot_number);
     }
     else {
-      lcopy((unsigned long)freeze_menu_bar, (unsigned long)&freeze_menu[LOAD_RESUME_OFFSET], 40);
+      compose_image(freeze_menu_bar, NULL, LOAD_RESUME_OFFSET / 40, 1);
       if (rom_changed)
-        lfill((unsigned long)&freeze_menu[LOAD_RESUME_OFFSET], ' ', 9);
+        compose_text(blank_field, LOAD_RESUME_OFFSET, 9);
 
       // Display "- PAUSED STATE -"
-      lcopy((unsigned long)" - PAUSED STATE -   ", (unsigned long)&freeze_menu[FREEZE_SLOT_OFFSET], 19);
+      compose_text(" - PAUSED STATE -   ", FREEZE_SLOT_OFFSET, 19);
     }
 
     // CPU MODE
     if (freeze_peek(0xffd367dL) & 0x20)
-      lcopy((unsigned long)"  4502", (unsigned long)&freeze_menu[CPU_MODE_OFFSET], 6);
+      compose_text("  4502", CPU_MODE_OFFSET, 6);
     else
-      lcopy((unsigned long)"  AUTO", (unsigned long)&freeze_menu[CPU_MODE_OFFSET], 6);
+      compose_text("  AUTO", CPU_MODE_OFFSET, 6);
 
     // Joystick 1/2 swap
-    lcopy((unsigned long)((PEEK(0xd612L) & 0x20) ? "YES" : " NO"), (unsigned long)&freeze_menu[JOY_SWAP_OFFSET], 3);
+    compose_text((PEEK(0xd612L) & 0x20) ? "YES" : " NO", JOY_SWAP_OFFSET, 3);
 
     // Cartridge enable
-    lcopy((unsigned long)((freeze_peek(0xffd367dL) & 0x01) ? "YES" : " NO"), (unsigned long)&freeze_menu[CART_ENABLE_OFFSET],
-        3);
+    compose_text((freeze_peek(0xffd367dL) & 0x01) ? "YES" : " NO", CART_ENABLE_OFFSET, 3);
 
     if (freeze_peek(0xFFD3054L) & 0x20) // PALEMU
-      lcopy((unsigned long)" ON", (unsigned long)&freeze_menu[CRTEMU_MODE_OFFSET], 3);
+      compose_text(" ON", CRTEMU_MODE_OFFSET, 3);
     else // PAL50
-      lcopy((unsigned long)"OFF", (unsigned long)&freeze_menu[CRTEMU_MODE_OFFSET], 3);
+      compose_text("OFF", CRTEMU_MODE_OFFSET, 3);
 
     if (freeze_peek(0xffd306fL) & 0x80) // NTSC60
-      lcopy((unsigned long)"NTSC60", (unsigned long)&freeze_menu[VIDEO_MODE_OFFSET], 6);
+      compose_text("NTSC60", VIDEO_MODE_OFFSET, 6);
     else // PAL50
-      lcopy((unsigned long)" PAL50", (unsigned long)&freeze_menu[VIDEO_MODE_OFFSET], 6);
+      compose_text(" PAL50", VIDEO_MODE_OFFSET, 6);
   }
 
   // ROM version
   /*
   if (part & UPDATE_ROM)
-    lcopy((long)detect_rom(), (unsigned long)&freeze_menu[ROM_NAME_OFFSET], 11);
+    compose_text(detect_rom(), ROM_NAME_OFFSET, 11);
   */
 
   // CPU frequency
   if (part & UPDATE_FREQ)
     switch (detect_cpu_speed()) {
     case 1:
-      lcopy((unsigned long)"  1", (unsigned long)&freeze_menu[CPU_FREQ_OFFSET], 3);
+      compose_text("  1", CPU_FREQ_OFFSET, 3);
       break;
     case 2:
-      lcopy((unsigned long)"  2", (unsigned long)&freeze_menu[CPU_FREQ_OFFSET], 3);
+      compose_text("  2", CPU_FREQ_OFFSET, 3);
       break;
     case 3:
-      lcopy((unsigned long)"3.5", (unsigned long)&freeze_menu[CPU_FREQ_OFFSET], 3);
+      compose_text("3.5", CPU_FREQ_OFFSET, 3);
       break;
     case 40:
-      lcopy((unsigned long)" 40", (unsigned long)&freeze_menu[CPU_FREQ_OFFSET], 3);
+      compose_text(" 40", CPU_FREQ_OFFSET, 3);
       break;
     default:
-      lcopy((unsigned long)"???", (unsigned long)&freeze_menu[CPU_FREQ_OFFSET], 3);
+      compose_text("???", CPU_FREQ_OFFSET, 3);
       break;
     }
 
-  if ((part & UPDATE_PROCESS) || (part & UPDATE_THUMB))
-    detect_rom();
+  if ((part & UPDATE_PROCESS) || (part & UPDATE_THUMB)) {
+    if (!(handoff_valid & HANDOFF_ROM))
+      detect_rom();
+    handoff_valid |= HANDOFF_ROM;
+  }
 
   /* Display info from the process descriptor
      The useful bits are:
@@ -444,29 +423,27 @@ void draw_freeze_menu(unsigned char part)
 
   if (part & UPDATE_PROCESS) {
     // Display process ID as decimal
-    screen_decimal((unsigned long)&freeze_menu[PROCESS_ID_OFFSET], process_descriptor.task_id);
+    compose_decimal(PROCESS_ID_OFFSET, process_descriptor.task_id);
 
     // Process name: only display if no unprintable PETSCII chars
     for (i = 0; i < 16; i++)
       if ((process_descriptor.process_name[i] & 0x7f) < 0x20)
         break;
     if (i == 16)
-      lcopy((unsigned long)process_descriptor.process_name, (unsigned long)&freeze_menu[PROCESS_NAME_OFFSET], 16);
+      compose_text(process_descriptor.process_name, PROCESS_NAME_OFFSET, 16);
     else
-      lcopy((unsigned long)"UNNAMED TASK    ", (unsigned long)&freeze_menu[PROCESS_NAME_OFFSET], 16);
+      compose_text("UNNAMED TASK    ", PROCESS_NAME_OFFSET, 16);
 
-    lcopy((unsigned long)mega65_rom_name, (unsigned long)&freeze_menu[PROCESS_ROM_OFFSET], 11);
+    compose_text(mega65_rom_name, PROCESS_ROM_OFFSET, 11);
   }
 
   if (part & UPDATE_DISK) {
     // Draw drive numbers for internal drive
-    lfill((unsigned long)&freeze_menu[DRIVE0_NUM_OFFSET], 0, 2);
-    lfill((unsigned long)&freeze_menu[DRIVE1_NUM_OFFSET], 0, 2);
-    screen_decimal((unsigned long)&freeze_menu[DRIVE0_NUM_OFFSET], freeze_peek(0x10113L));
-    screen_decimal((unsigned long)&freeze_menu[DRIVE1_NUM_OFFSET], freeze_peek(0x10114L));
+    compose_decimal(DRIVE0_NUM_OFFSET, freeze_peek(0x10113L));
+    compose_decimal(DRIVE1_NUM_OFFSET, freeze_peek(0x10114L));
 
-    lfill((unsigned long)&freeze_menu[D81_IMAGE0_NAME_OFFSET], ' ', 18);
-    lfill((unsigned long)&freeze_menu[D81_IMAGE1_NAME_OFFSET], ' ', 18);
+    compose_text(blank_field, D81_IMAGE0_NAME_OFFSET, 18);
+    compose_text(blank_field, D81_IMAGE1_NAME_OFFSET, 18);
 
     // Show name of current mounted disk image
     if (process_descriptor.d81_image0_namelen) {
@@ -475,7 +452,7 @@ void draw_freeze_menu(unsigned char part)
           break;
       if (i == process_descriptor.d81_image0_namelen) {
         topetsciiupper(process_descriptor.d81_image0_name, process_descriptor.d81_image0_namelen);
-        lcopy((unsigned long)process_descriptor.d81_image0_name, (unsigned long)&freeze_menu[D81_IMAGE0_NAME_OFFSET],
+        compose_text(process_descriptor.d81_image0_name, D81_IMAGE0_NAME_OFFSET,
             process_descriptor.d81_image0_namelen < 18 ? process_descriptor.d81_image0_namelen : 18);
       }
     }
@@ -486,21 +463,12 @@ void draw_freeze_menu(unsigned char part)
           break;
       if (i == process_descriptor.d81_image1_namelen) {
         topetsciiupper(process_descriptor.d81_image1_name, process_descriptor.d81_image1_namelen);
-        lcopy((unsigned long)process_descriptor.d81_image1_name, (unsigned long)&freeze_menu[D81_IMAGE1_NAME_OFFSET],
+        compose_text(process_descriptor.d81_image1_name, D81_IMAGE1_NAME_OFFSET,
             process_descriptor.d81_image1_namelen < 18 ? process_descriptor.d81_image1_namelen : 18);
       }
     }
   }
 
-  // wait till raster leaves screen
-  while (PEEK(0xD012U) < 0xf8)
-    continue;
-
-  // Freezer can't use printf() etc, because C64 ROM has not started, so ZP will be a mess
-  // (in fact, most of memory contains what the frozen program had. Only our freezer program
-  // itself has been loaded to replace some of RAM).
-  copy_convert_to_screen(freeze_menu, 0);
-
   // Draw the thumbnail surround area
   if (part & UPDATE_THUMB) {
     int8_t thumb_frame = F_M65;
@@ -544,18 +512,21 @@ void draw_freeze_menu(unsigned char part)
       // Work out where the screen data begins
       screen_data_start = lpeek(0x5203dL) + (lpeek(0x5203eL) << 8);
       screen_data_start += 0x52000L + 0x40L;
-      for (y = 0; y < 13; y++) {
+      // (the frame has 13 rows, but only the first 12 are on screen)
+      for (y = 0; y < 12; y++) {
         // Copy row of screen data
-        lcopy(screen_data_start + (y << 6), SCREEN_ADDRESS + (13 * 80) + (y * 80), (19 * 2));
+        lburst_read(screen_data_start + (y << 6), (19 * 2));
         // Add tile number based on data starting at $52040 = $1481
-        for (x = 0; x < 19; x++) {
-          tile_num = (unsigned short*)(SCREEN_ADDRESS + (13 * 80) + (y * 80) + (x << 1));
+        tile_num = (unsigned short*)lburst_buffer;
+        for (x = 0; x < 19; x++, tile_num++) {
           if (*tile_num)
             (*tile_num) += tile_offset;
           else
             *tile_num = 0x20;
         }
+        lburst_write(compose_row_address(13 + y), (19 * 2));
       }
+      compose_mark_dirty(13, 12);
       thumb_xoff = lpeek(0x52020L);
       thumb_yoff = thumb_xoff >> 4;
       thumb_xoff &= 0xf;
@@ -571,15 +542,22 @@ void draw_freeze_menu(unsigned char part)
     // This sits in the region below the menu where we will also have left and right arrows,
     // the program name etc, so you can easily browse through the freeze slots.
     draw_thumbnail();
-    for (x = 0; x < 9; x++)
-      for (y = 0; y < 6; y++) {
-        POKE(SCREEN_ADDRESS + (80 * 13) + ((thumb_xoff + x) * 2) + ((thumb_yoff + y) * 80) + 0, x * 6 + y); // $50000 base address
-        POKE(SCREEN_ADDRESS + (80 * 13) + ((thumb_xoff + x) * 2) + ((thumb_yoff + y) * 80) + 1, 0x14);      // $50000 base address
+    for (y = 0; y < 6; y++) {
+      for (x = 0; x < 9; x++) {
+        lburst_buffer[(x << 1) + 0] = x * 6 + y; // $50000 base address
+        lburst_buffer[(x << 1) + 1] = 0x14;      // $50000 base address
       }
+      lburst_write(compose_row_address(13 + thumb_yoff + y) + (thumb_xoff << 1), 9 * 2);
+    }
+    // (mark the whole area, which also undoes any touch swipe of the visible screen)
+    compose_mark_dirty(13, 12);
   }
 
+  compose_flush();
+
   // restore border colour (fdisk/sd stuff still twiddles with it)
   POKE(0xD020U, 6);
+  PROF_END(PROF_DRAW_FREEZE_MENU);
 }
 
 // NOTE: I wanted to tweak the string to look nicer, but this gave me dos driver errors once back in BASIC (doing a DIR)
@@ -707,6 +685,69 @@ void debug_region_list()
 }
 #endif
 
+/*
+  The default font is kept in attic RAM, so that putting it back into the
+  chargen area (on resume, and on F14) doesn't have to read it from the SD
+  card every time. It is read from DEFAULT_CHARSET or MAIN_ROM_FILE the
+  first time it is needed after power on, and its checksum is checked every
+  time it is used.
+*/
+#define CHARSET_MAGIC_ADDRESS (ATTIC_CHARSET_ADDRESS + 0x0000)
+#define CHARSET_CHECKSUM_ADDRESS (ATTIC_CHARSET_ADDRESS + 0x0004)
+#define CHARSET_DATA_ADDRESS (ATTIC_CHARSET_ADDRESS + 0x0100)
+
+static unsigned char charset_magic[4] = { 'C', 'H', 'R', 'S' };
+
+unsigned short charset_checksum(void)
+{
+  unsigned char sum1 = 0, sum2 = 0, i, j;
+
+  for (j = 0; j < 16; j++) {
+    lburst_read(CHARSET_DATA_ADDRESS + ((unsigned short)j << 8), 256);
+    i = 0;
+    do {
+      sum1 += lburst_buffer[i];
+      sum2 += sum1;
+    } while (++i);
+  }
+  return sum1 | (sum2 << 8);
+}
+
+unsigned char charset_cached(void)
+{
+  // Make sure the font is in attic RAM. Returns 0 if it couldn't be loaded.
+  unsigned short checksum;
+  struct file_stat st;
+
+  lcopy(CHARSET_MAGIC_ADDRESS, (long)lburst_buffer, 6);
+  checksum = lburst_buffer[4] | (lburst_buffer[5] << 8);
+  if (!memcmp(lburst_buffer, charset_magic, 4) && charset_checksum() == checksum)
+    return 1;
+
+  // try to load DEFAULT_CHARSET or the font out of MEGA65.ROM (just the 4KB of it,
+  // if the ROM is big enough to have one)
+  lfill(CHARSET_MAGIC_ADDRESS, 0, 4);
+  if (!file_load(DEFAULT_CHARSET, 0, CHARSET_DATA_ADDRESS, 4096)
+      && (file_stat(MAIN_ROM_FILE, &st) || st.size < 0xE000L
+          || !file_load(MAIN_ROM_FILE, 0xD000L, CHARSET_DATA_ADDRESS, 4096)))
+    return 0;
+
+  checksum = charset_checksum();
+  lcopy((long)&checksum, CHARSET_CHECKSUM_ADDRESS, 2);
+  lcopy((long)charset_magic, CHARSET_MAGIC_ADDRESS, 4);
+  return 1;
+}
+
+unsigned char charset_differs(unsigned char sector)
+{
+  // Is the chargen sector in sector_buffer different from the font?
+  lburst_read(CHARSET_DATA_ADDRESS + 512L * sector, 256);
+  if (memcmp(sector_buffer, lburst_buffer, 256))
+    return 1;
+  lburst_read(CHARSET_DATA_ADDRESS + 512L * sector + 256, 256);
+  return memcmp(sector_buffer + 256, lburst_buffer, 256) != 0;
+}
+
 #define CHARGEN_FIXMEM  0x01 // write char data to chargen memory
 #define CHARGEN_FIXSLOT 0x02 // write char data to slot storage
 #define CHARGEN_FORCE   0x40 // if check can't load region, do fix anyway
@@ -714,7 +755,6 @@ void debug_region_list()
 void fix_chargen_area(unsigned char flags)
 {
   unsigned short i = 512; // needs to be 512 for nocheck to trigger!
-  long charset_start;
 
   // debug_region_list();
 
@@ -729,22 +769,17 @@ void fix_chargen_area(unsigned char flags)
 
   // if first chargen sector was zero...
   if (i == 512) {
-    charset_start = -1;
-    // try to load DEFAULT_CHARSET or MEGA65.ROM
-    if (!read_file_from_sdcard(DEFAULT_CHARSET, 0x40000L))
-      charset_start = 0x40000L;
-    else if (!read_file_from_sdcard(MAIN_ROM_FILE, 0x40000L))
-      charset_start = 0x4D000L;
-
-    if (charset_start != -1) {
+    if (charset_cached()) {
       // copy the font to chargen WOM directly
       if (flags & CHARGEN_FIXMEM)
-        lcopy(charset_start, CHARGEN_ADDRESS, 4096);
+        lcopy(CHARSET_DATA_ADDRESS, CHARGEN_ADDRESS, 4096);
 
-      // should we also fix the slot?
+      // should we also fix the slot? (only the sectors that are different)
       if (flags & CHARGEN_FIXSLOT)
         for (i = 0; i < 8; i++) {
-          lcopy(charset_start + 512L*i, (long)sector_buffer, 512);
+          if (!freeze_fetch_sector(CHARGEN_ADDRESS + 512L*i, NULL) && !charset_differs(i))
+            continue;
+          lcopy(CHARSET_DATA_ADDRESS + 512L*i, (long)sector_buffer, 512);
           freeze_store_sector(CHARGEN_ADDRESS + 512L*i, NULL);
         }
     }
@@ -759,12 +794,28 @@ void fix_chargen_area(unsigned char flags)
   }
 }
 
+void cache_freezer_tool(char* name)
+{
+  // Make sure the tool is in the tool cache, as it is on the SD card now
+  struct file_stat st;
+  unsigned char slot;
+
+  if (file_stat(name, &st) || !st.size || st.size > TOOLCACHE_MAX_SIZE)
+    return;
+  if (toolcache_fresh(name, st.size, st.cluster, st.modified))
+    return;
+  slot = toolcache_claim(name, st.size);
+  if (file_load(name, 0, toolcache_data_address(toolcache_header.page), st.size) == st.size)
+    toolcache_seal(slot, name, st.size, st.cluster, st.modified);
+}
+
 void start_freezer_tool(char *toolfile)
 {
   char x = 0, start_tool = 0;
 
   if (not_in_root) {
-    copy_convert_to_screen(freeze_root_warn, TOOLS_MENU_OFFSET);
+    compose_image(freeze_root_warn, NULL, TOOLS_MENU_ROW, FREEZE_ROOT_WARN_ROWS);
+    compose_flush();
 
     while (!start_tool) {
       while (!(x = PEEK(0xD610U)));
@@ -779,12 +830,18 @@ void start_freezer_tool(char *toolfile)
         case 'N':
         case 0x1b:
         case 0x03:
+          compose_image(&freeze_menu[TOOLS_MENU_ROW * 40], NULL, TOOLS_MENU_ROW, FREEZE_ROOT_WARN_ROWS);
           draw_freeze_menu(UPDATE_TOP);
           return;
       }
     }
   }
-  mega65_dos_exechelper(toolfile);
+  // The tool, and the freezer to come back to, from attic RAM if we can
+  cache_freezer_tool(toolfile);
+  cache_freezer_tool("FREEZER.M65");
+  handoff_give();
+  toolcache_exec(toolfile);
+  handoff_cancel();
 }
 
 #ifdef __CC65__
@@ -844,7 +901,11 @@ int main(int argc, char** argv)
   POKE(0xD458U, 0);
   POKE(0xD478U, 0);
 
-  set_palette();
+  // Skip what the tool that started us has already done (after a new
+  // freeze, this finds nothing, and we start from scratch)
+  handoff_take();
+  if (!(handoff_valid & HANDOFF_PALETTE))
+    set_palette();
   make_colour_lookup();
 
   // assure we're viewing the sdcard's sector buffer (and not the floppy disk buffer)
@@ -853,8 +914,10 @@ int main(int argc, char** argv)
 
   // Now find the start sector of the slot, and make a copy for safe keeping
   slot_number = 0;
-  find_freeze_slot_start_sector(slot_number);
-  freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  if (!(handoff_valid & HANDOFF_SLOT)) {
+    find_freeze_slot_start_sector(slot_number);
+    freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  }
 
   // SD or SDHC card?
   if (PEEK(0xD680U) & 0x10)
@@ -862,7 +925,9 @@ int main(int argc, char** argv)
   else
     sdhc_card = 0;
 
-  request_freeze_region_list();
+  if (!(handoff_valid & HANDOFF_SLOT))
+    request_freeze_region_list();
+  handoff_valid |= HANDOFF_PALETTE | HANDOFF_SLOT;
 
   // BASIC65 unmount will just poke D6A1, and
   // not use hyppo, because we don't have a fucntion
@@ -874,10 +939,11 @@ int main(int argc, char** argv)
     store_selected_disk_image(0, INTERNAL_DRIVE_0);
 
   setup_menu_screen();
-  predraw_freeze_menu();
-  //chargen fix needs happen before the thumbnail frame is loaded as it clobbers
-  //the thumbnail frame data.
+  //the font comes from (or is loaded into) attic RAM, so the chargen fix
+  //doesn't clobber the thumbnail frame data or the compositor's shadow screen.
   fix_chargen_area(CHARGEN_FIXMEM | CHARGEN_NOCHECK);
+  sched_init();
+  predraw_freeze_menu();
   draw_freeze_menu(UPDATE_ALL);
 
 
@@ -889,8 +955,10 @@ int main(int argc, char** argv)
   POKE(0xDC00U, 0xFF);
   POKE(0xDC02U, 0x00);
 
-  // Main keyboard input loop
+  // Main keyboard input loop, once per frame, with the thumbnail
+  // loading in the background
   while (1) {
+    sched_run();
     {
       unsigned char c = PEEK(0xD610U);
 
@@ -940,10 +1008,8 @@ int main(int argc, char** argv)
               x = 0;
             if (x > 39)
               x = 39;
-            for (y = 0; y < x * 2; y += 2)
-              lpoke(SCREEN_ADDRESS + y, 0xA0);
-            for (; y < 80; y += 2)
-              lpoke(SCREEN_ADDRESS + y, 0x20);
+            lmask(SCREEN_ADDRESS, x * 2, 2, 0x00, 0xA0);
+            lmask(SCREEN_ADDRESS + x * 2, 80 - x * 2, 2, 0x00, 0x20);
             y = 0;
             lpoke(0xFFD7035L, 0xff - (x * 5));
           }
@@ -1056,6 +1122,19 @@ int main(int argc, char** argv)
           draw_freeze_menu(UPDATE_TOP);
           break;
 
+#ifdef WITH_PROFILING
+        case 'Q':
+        case 'q': // Profiling report, until a key is pressed
+          dirlist_benchmark();
+          prof_report(1);
+          while (!PEEK(0xD610U))
+            continue;
+          POKE(0xD610U, 0);
+          compose_mark_dirty(0, PROF_SECTIONS);
+          compose_flush();
+          break;
+#endif
+
 #if 0
       case 'P': case 'p': // Toggle ROM area write-protect
   freeze_poke(0xFFD367dL,freeze_peek(0xFFD367dL)^0x04);
@@ -1262,13 +1341,10 @@ int main(int argc, char** argv)
 
         case 0xfe: // F14 - restore CHARSET from FILE
           {
-            // clear screen first
-            predraw_freeze_menu();
             // don't check, just put font into chargen
             fix_chargen_area(CHARGEN_NOCHECK | CHARGEN_FIXMEM);
-            // we need to redraw everything, because loading the ROM
-            // will mess things up (thumbnail for example)
-            last_thumb_frame = 255; // invalidate thumbnail
+            // then clear screen and redraw everything in the new font
+            predraw_freeze_menu();
             draw_freeze_menu(UPDATE_ALL);
           }
           break;
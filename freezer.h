@@ -14,6 +14,7 @@ char cdecl mega65_dos_cdroot();
 char cdecl mega65_dos_d81attach0(char* image_name);
 char cdecl mega65_dos_d81attach1(char* image_name);
 char cdecl mega65_dos_exechelper(char* filename);
+void exec_cached(unsigned char* dmalist);
 void fetch_freeze_region_list_from_hypervisor(unsigned short);
 unsigned char find_freeze_slot_start_sector(unsigned short);
 char cdecl read_file_from_sdcard(char* filename, uint32_t load_address);
@@ -22,6 +23,9 @@ unsigned char opendir(void);
 struct m65_dirent* readdir(unsigned char);
 void closedir(unsigned char);
 void closeall(void);
+unsigned char openfile(char* filename);
+unsigned short readfile(unsigned char fd);
+void closefile(unsigned char fd);
 
 void freeze_monitor(void);
 
@@ -3,14 +3,6 @@
 
 #include "ascii.h"
 
-// Used to quickly return from functions if a navigation key has been pressed
-// (used to avoid delays when navigating through the list of freeze slots
-#define NAVIGATION_KEY_CHECK()                                                                                              \
-  {                                                                                                                         \
-    if (((PEEK(0xD610U) & 0x7f) == 0x11) || ((PEEK(0xD610U) & 0x7f) == 0x1D))                                               \
-      return;                                                                                                               \
-  }
-
 extern uint8_t sector_buffer[512];
 #define clear_sector_buffer() lfill((uint32_t)sector_buffer, 0, 512)
 
@@ -0,0 +1,103 @@
+/*
+  Off-screen compositor for the freeze menu.
+
+  See freezer_compose.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "freezer_compose.h"
+#include "fdisk_memory.h"
+#include "fdisk_screen.h"
+
+// One bit per screen row that differs from what is currently visible
+static uint32_t compose_dirty = 0;
+
+void compose_image(unsigned char* screen, unsigned char* colour, unsigned char row, unsigned char count)
+{
+  // Images from tools/screenh have one byte per character cell, so spread
+  // them over the 16-bit screen and colour RAM with strided DMAs
+  lcopy_stride((long)screen, compose_row_address(row), count * 40, 2);
+  lfill_stride(compose_row_address(row) + 1, 0x00, count * 40, 2);
+  if (colour) {
+    lfill_stride(compose_colour_address(row), 0x00, count * 40, 2);
+    lcopy_stride((long)colour, compose_colour_address(row) + 1, count * 40, 2);
+  }
+
+  compose_mark_dirty(row, count);
+}
+
+void compose_mark_dirty(unsigned char row, unsigned char count)
+{
+  while (count--)
+    compose_dirty |= 1UL << row++;
+}
+
+void compose_text(char* data, unsigned short offset, unsigned short len)
+{
+  // Convert ASCII to screen codes a row at a time.
+  // Rows are only marked dirty if something on them actually changed.
+  // (Freezer can't use printf() etc, because C64 ROM has not started, so ZP will be a mess)
+  unsigned char row, col, n, i, sc, changed;
+
+  row = offset / 40;
+  col = offset % 40;
+  while (len && *data) {
+    n = 40 - col;
+    if (n > len)
+      n = len;
+    lburst_read(compose_row_address(row) + (col << 1), n << 1);
+    changed = 0;
+    for (i = 0; i < n && data[i]; i++) {
+      if ((data[i] >= 'A') && (data[i] <= 'Z'))
+        sc = data[i] - 0x40;
+      else if ((data[i] >= 'a') && (data[i] <= 'z'))
+        sc = data[i] - 0x20;
+      else
+        sc = data[i];
+      if (lburst_buffer[i << 1] != sc || lburst_buffer[(i << 1) + 1]) {
+        lburst_buffer[(i << 1) + 0] = sc;
+        lburst_buffer[(i << 1) + 1] = 0;
+        changed = 1;
+      }
+    }
+    if (changed) {
+      lburst_write(compose_row_address(row) + (col << 1), n << 1);
+      compose_mark_dirty(row, 1);
+    }
+    if (i < n)
+      break;
+    data += n;
+    len -= n;
+    row++;
+    col = 0;
+  }
+}
+
+void compose_flush(void)
+{
+  unsigned char row, first;
+
+  if (!compose_dirty)
+    return;
+
+  // wait till raster leaves screen
+  while (PEEK(0xD012U) < 0xf8)
+    continue;
+
+  // Copy each run of dirty rows with one DMA for the screen and one for colour RAM
+  row = 0;
+  while (row < COMPOSE_ROWS) {
+    if (!(compose_dirty & (1UL << row))) {
+      row++;
+      continue;
+    }
+    first = row;
+    while (row < COMPOSE_ROWS && (compose_dirty & (1UL << row)))
+      row++;
+    lcopy(compose_row_address(first), SCREEN_ADDRESS + first * COMPOSE_ROW_BYTES, (row - first) * COMPOSE_ROW_BYTES);
+    lcopy(compose_colour_address(first), 0xff80000L + first * COMPOSE_ROW_BYTES, (row - first) * COMPOSE_ROW_BYTES);
+  }
+
+  compose_dirty = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __FREEZER_COMPOSE_H__
+#define __FREEZER_COMPOSE_H__
+
+/*
+  Off-screen compositor for the freeze menu.
+
+  All drawing goes into a shadow copy of the 16-bit screen and its colour RAM
+  at the top of bank 5, and each row that changes is marked dirty.
+  compose_flush() then waits for the raster to leave the visible area, and
+  DMAs only the dirty rows to SCREEN_ADDRESS and colour RAM, so that the user
+  never sees a half-drawn screen.
+
+  NOTE: The area $40000-$5FFFF is also used as scratch space (e.g., slot
+  copies, and the thumbnail frames), so anything put there has to stay below
+  the shadow screen.
+*/
+
+#define COMPOSE_SCREEN_ADDRESS 0x5F000L
+#define COMPOSE_COLOUR_ADDRESS 0x5F800L
+#define COMPOSE_ROWS 25
+#define COMPOSE_ROW_BYTES 80
+
+#define compose_row_address(row) (COMPOSE_SCREEN_ADDRESS + (row) * COMPOSE_ROW_BYTES)
+#define compose_colour_address(row) (COMPOSE_COLOUR_ADDRESS + (row) * COMPOSE_ROW_BYTES)
+
+void compose_image(unsigned char* screen, unsigned char* colour, unsigned char row, unsigned char count);
+void compose_mark_dirty(unsigned char row, unsigned char count);
+void compose_text(char* data, unsigned short offset, unsigned short len);
+void compose_flush(void);
+
+#endif /* __FREEZER_COMPOSE_H__ */
@@ -0,0 +1,130 @@
+/*
+  Making a fragmented disk image contiguous.
+
+  See freezer_defrag.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_fat32.h"
+#include "freezer_defrag.h"
+
+uint32_t defrag_cluster;
+
+// Sectors copied per batch (64KB of attic RAM)
+#define DEFRAG_BATCH 128
+
+// Hypervisor error codes we return
+#define DEFRAG_INVALID_CLUSTER 0x85
+#define DEFRAG_FILE_NOT_FOUND 0x88
+#define DEFRAG_NO_SPACE 0x8c
+
+// Where the directory entry of the image is
+static uint32_t entry_sector;
+static unsigned short entry_offset;
+
+static unsigned char defrag_find_entry(uint32_t cluster, uint32_t first_cluster, uint32_t size)
+{
+  unsigned char sn;
+  unsigned short offset;
+  unsigned char* e;
+
+  while (cluster >= 2 && cluster < FAT32_END_OF_CHAIN) {
+    for (sn = 0; sn < sectors_per_cluster; sn++) {
+      entry_sector = fat32_cluster_sector(cluster) + sn;
+      sdcard_readsector(entry_sector);
+      for (offset = 0; offset < 512; offset += 32) {
+        e = &sector_buffer[offset];
+        if (!e[0])
+          return 0;
+        // Skip deleted entries, long name parts, the volume label and directories
+        if (e[0] == 0xe5 || e[11] == 0x0f || (e[11] & 0x18))
+          continue;
+        if (*(uint32_t*)&e[0x1c] == size
+            && first_cluster == (e[0x1a] | ((uint32_t)e[0x1b] << 8) | ((uint32_t)e[0x14] << 16) | ((uint32_t)e[0x15] << 24))) {
+          entry_offset = offset;
+          return 1;
+        }
+      }
+    }
+    cluster = fat32_follow_cluster(cluster) & 0x0fffffffUL;
+  }
+  return 0;
+}
+
+static unsigned char defrag_copy(uint32_t from, uint32_t sectors)
+{
+  // Copy the image along its old cluster chain into the new run of clusters
+  uint32_t dest = fat32_cluster_sector(defrag_cluster);
+  unsigned char sn = 0, i, n;
+
+  while (sectors) {
+    n = sectors < DEFRAG_BATCH ? sectors : DEFRAG_BATCH;
+    for (i = 0; i < n; i++) {
+      if (sn == sectors_per_cluster) {
+        from = fat32_follow_cluster(from) & 0x0fffffffUL;
+        if (from < 2 || from >= FAT32_END_OF_CHAIN)
+          return 0;
+        sn = 0;
+      }
+      sdcard_readsector(fat32_cluster_sector(from) + sn++);
+      lcopy((long)sector_buffer, ATTIC_COPY_ADDRESS + ((long)i << 9), 512);
+    }
+    POKE(0xD020, PEEK(0xD020) + 1);
+    fat32_write_sectors(dest, ATTIC_COPY_ADDRESS, n);
+    dest += n;
+    sectors -= n;
+  }
+  return 1;
+}
+
+unsigned char defrag_image(uint32_t first_cluster, uint32_t size)
+{
+  uint32_t cluster, clusters, sectors, n;
+  unsigned char* e;
+
+  if (!sectors_per_cluster)
+    fat32_open_file_system();
+  if (!sectors_per_cluster || !defrag_find_entry(fat32_current_dir_cluster(), first_cluster, size))
+    return DEFRAG_FILE_NOT_FOUND;
+
+  sectors = (size + 511) >> 9;
+  clusters = (sectors + sectors_per_cluster - 1) / sectors_per_cluster;
+
+  // Make sure the old chain is all there before we start
+  cluster = first_cluster;
+  for (n = 1; n < clusters; n++) {
+    cluster = fat32_follow_cluster(cluster) & 0x0fffffffUL;
+    if (cluster < 2 || cluster >= FAT32_END_OF_CHAIN)
+      return DEFRAG_INVALID_CLUSTER;
+  }
+
+  defrag_cluster = fat32_find_contiguous(clusters);
+  if (!defrag_cluster)
+    return DEFRAG_NO_SPACE;
+  fat32_write_chain(defrag_cluster, clusters);
+  fat32_sync();
+  fat32_update_fsinfo(fsinfo_next_free, clusters);
+
+  if (!defrag_copy(first_cluster, sectors)) {
+    fat32_free_chain(defrag_cluster);
+    fat32_sync();
+    return DEFRAG_INVALID_CLUSTER;
+  }
+
+  // Point the directory entry at the copy
+  sdcard_readsector(entry_sector);
+  e = &sector_buffer[entry_offset];
+  e[0x1a] = defrag_cluster;
+  e[0x1b] = defrag_cluster >> 8;
+  e[0x14] = defrag_cluster >> 16;
+  e[0x15] = defrag_cluster >> 24;
+  sdcard_writesector(entry_sector, 0);
+
+  // And only then let go of the old one
+  fat32_free_chain(first_cluster);
+  fat32_sync();
+  return 0;
+}
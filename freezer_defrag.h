@@ -0,0 +1,30 @@
+#ifndef __FREEZER_DEFRAG_H__
+#define __FREEZER_DEFRAG_H__
+
+/*
+  Making a fragmented disk image contiguous, so that it can be mounted.
+
+  The hypervisor maps the sectors of a mounted image straight onto the SD
+  card, so it refuses images whose clusters are not all in a row (error $8B).
+  defrag_image() fixes that in place, for an image in the current directory:
+
+    1. find a free run of clusters big enough for the image, and chain it
+    2. copy the image into it, a batch of sectors at a time through attic RAM
+    3. point the directory entry of the image at the copy
+    4. free the old cluster chain
+
+  Until step 3, the image itself is untouched, and if anything goes wrong
+  after that, the worst that can happen is that the old clusters are lost.
+
+  The image is recognised in the directory by its start cluster and size,
+  both as the hypervisor reported them, so that we never change an entry
+  of a partition other than the one the hypervisor is using.
+*/
+
+// Start cluster of the image, after a successful defrag_image()
+extern uint32_t defrag_cluster;
+
+// Returns 0 on success, else a hypervisor style error code for display_error()
+unsigned char defrag_image(uint32_t first_cluster, uint32_t size);
+
+#endif /* __FREEZER_DEFRAG_H__ */
@@ -0,0 +1,189 @@
+/*
+  Directory listing cache in attic RAM.
+
+  See freezer_dircache.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freezer.h"
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_fat32.h"
+#include "freezer_dirlist.h"
+#include "freezer_dircache.h"
+
+unsigned short dircache_count;
+unsigned char dircache_flags;
+
+// (Bump the last character when the records change)
+static unsigned char dircache_magic[4] = { 'D', 'I', 'R', '2' };
+static unsigned char dircache_fs_open = 0;
+
+// Directory seen by the last dircache_lookup(), for dircache_store()
+static unsigned char dircache_valid = 0;
+static uint32_t dircache_cluster;
+static unsigned short dircache_entries, dircache_checksum;
+
+// The slot table lives in lburst_buffer while we work on it
+#define dircache_slots ((struct dircache_slot*)lburst_buffer)
+
+static void dircache_read_table(void)
+{
+  lcopy(DIRCACHE_MAGIC_ADDRESS, (long)lburst_buffer, 4);
+  if (memcmp(lburst_buffer, dircache_magic, 4)) {
+    // Nothing (valid) there yet
+    lfill(ATTIC_DIRCACHE_ADDRESS, 0, 0x200);
+    lcopy((long)dircache_magic, DIRCACHE_MAGIC_ADDRESS, 4);
+  }
+  lburst_read(DIRCACHE_TABLE_ADDRESS, DIRCACHE_SLOTS * sizeof(struct dircache_slot));
+}
+
+static unsigned short dircache_tick(void)
+{
+  // Age counter for replacing the least recently used slot
+  unsigned short clock;
+
+  lcopy(DIRCACHE_CLOCK_ADDRESS, (long)&clock, 2);
+  clock++;
+  lcopy((long)&clock, DIRCACHE_CLOCK_ADDRESS, 2);
+  return clock;
+}
+
+static unsigned char dircache_signature(uint32_t cluster, uint32_t first_cluster)
+{
+  // Count and checksum the raw directory entries up to the end of directory
+  // marker, and make sure that the first real one is the one the hypervisor
+  // returned first.
+  unsigned char sum1 = 0, sum2 = 0, sn, i, have_first = 0;
+  unsigned char* e;
+  unsigned short offset;
+
+  dircache_entries = 0;
+  while (cluster >= 2 && cluster < FAT32_END_OF_CHAIN) {
+    for (sn = 0; sn < sectors_per_cluster; sn++) {
+      sdcard_readsector(fat32_cluster_sector(cluster) + sn);
+      for (offset = 0; offset < 512; offset += 32) {
+        e = &sector_buffer[offset];
+        if (!e[0])
+          goto end_of_directory;
+        // Skip deleted entries, long name parts and the volume label
+        if (!have_first && e[0] != 0xe5 && e[11] != 0x0f && !(e[11] & 0x08)) {
+          if (first_cluster != (e[0x1a] | ((uint32_t)e[0x1b] << 8) | ((uint32_t)e[0x14] << 16) | ((uint32_t)e[0x15] << 24)))
+            return 0;
+          have_first = 1;
+        }
+        for (i = 0; i < 32; i++) {
+          sum1 += e[i];
+          sum2 += sum1;
+        }
+        dircache_entries++;
+      }
+    }
+    cluster = fat32_follow_cluster(cluster) & 0x0fffffffUL;
+  }
+
+end_of_directory:
+  dircache_checksum = sum1 | (sum2 << 8);
+  return have_first;
+}
+
+unsigned char dircache_lookup(unsigned char kind)
+{
+  // Look for an up to date listing of the current directory.
+  // Returns the cache slot, or DIRCACHE_MISS.
+  unsigned char dir, slot;
+  struct m65_dirent* dirent;
+
+  dircache_valid = 0;
+
+  if (!dircache_fs_open) {
+    fat32_open_file_system();
+    dircache_fs_open = 1;
+  }
+  if (!sectors_per_cluster)
+    return DIRCACHE_MISS;
+
+  // In a sub-directory, the first entry is "." which points to the directory itself.
+  // (We don't keep the directory open, as we are about to read sectors behind the
+  // hypervisor's back)
+  closeall();
+  dir = opendir();
+  dirent = readdir(dir);
+  closedir(dir);
+  if (!dirent || ((unsigned short)dirent == 0xffffU))
+    return DIRCACHE_MISS;
+  if (!strcmp(dirent->d_name, "."))
+    dircache_cluster = dirent->d_ino;
+  else
+    dircache_cluster = root_dir_cluster;
+
+  if (!dircache_signature(dircache_cluster, dirent->d_ino))
+    return DIRCACHE_MISS;
+  dircache_valid = kind;
+
+  dircache_read_table();
+  for (slot = 0; slot < DIRCACHE_SLOTS; slot++) {
+    if (dircache_slots[slot].kind == kind && dircache_slots[slot].cluster == dircache_cluster) {
+      if (dircache_slots[slot].entries != dircache_entries || dircache_slots[slot].checksum != dircache_checksum)
+        return DIRCACHE_MISS;
+      dircache_count = dircache_slots[slot].count;
+      dircache_flags = dircache_slots[slot].flags;
+      dircache_slots[slot].age = dircache_tick();
+      lburst_write(DIRCACHE_TABLE_ADDRESS, DIRCACHE_SLOTS * sizeof(struct dircache_slot));
+      return slot;
+    }
+  }
+  return DIRCACHE_MISS;
+}
+
+static void dircache_rebase_index(unsigned short first, unsigned short count, short offset)
+{
+  // The index is stored relative to the first record, in case that moves
+  unsigned short i;
+
+  for (i = first; i < first + count; i++)
+    dirlist_index[i] += offset;
+}
+
+void dircache_load(unsigned char slot, unsigned short first)
+{
+  lcopy(dircache_records_address(slot), dir_record_address(first), dircache_count << 6);
+  lcopy(dircache_index_address(slot), (long)&dirlist_index[first], dircache_count << 1);
+  dircache_rebase_index(first, dircache_count, first);
+}
+
+void dircache_store(unsigned char kind, unsigned short first, unsigned short count, unsigned char flags)
+{
+  // Remember the listing of the directory of the last dircache_lookup()
+  unsigned char slot, victim = 0;
+
+  if (dircache_valid != kind || count > DIRCACHE_SLOT_RECORDS)
+    return;
+
+  // Same directory, else a free slot, else the least recently used one
+  dircache_read_table();
+  for (slot = 0; slot < DIRCACHE_SLOTS; slot++) {
+    if (dircache_slots[slot].kind == kind && dircache_slots[slot].cluster == dircache_cluster)
+      break;
+    if (dircache_slots[victim].kind && (!dircache_slots[slot].kind || dircache_slots[slot].age < dircache_slots[victim].age))
+      victim = slot;
+  }
+  if (slot == DIRCACHE_SLOTS)
+    slot = victim;
+
+  lcopy(dir_record_address(first), dircache_records_address(slot), count << 6);
+  dircache_rebase_index(first, count, -first);
+  lcopy((long)&dirlist_index[first], dircache_index_address(slot), count << 1);
+  dircache_rebase_index(first, count, first);
+
+  dircache_slots[slot].cluster = dircache_cluster;
+  dircache_slots[slot].kind = kind;
+  dircache_slots[slot].flags = flags;
+  dircache_slots[slot].count = count;
+  dircache_slots[slot].entries = dircache_entries;
+  dircache_slots[slot].checksum = dircache_checksum;
+  dircache_slots[slot].age = dircache_tick();
+  lburst_write(DIRCACHE_TABLE_ADDRESS, DIRCACHE_SLOTS * sizeof(struct dircache_slot));
+}
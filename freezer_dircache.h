@@ -0,0 +1,68 @@
+#ifndef __FREEZER_DIRCACHE_H__
+#define __FREEZER_DIRCACHE_H__
+
+/*
+  Directory listing cache in attic RAM, shared by the disk chooser and the
+  ROM loader.
+
+  Scanning a directory through the hypervisor takes one trap per entry,
+  which for a directory of hundreds of disk images takes seconds. So the
+  64 byte records a scan produces are kept in attic RAM, keyed by the start
+  cluster of the directory and the kind of listing, together with their
+  sorted order from dirlist_index[].
+
+  To tell whether the directory has changed since, dircache_lookup() reads
+  the raw directory entries from the SD card (far fewer sectors than there
+  are readdir() calls), and compares their number and a checksum with what
+  was stored. The first raw entry also has to match the first entry the
+  hypervisor returns, in case the partition we parsed is not the one the
+  hypervisor is using, in which case nothing is cached.
+
+  Usage:
+
+    slot = dircache_lookup(kind);
+    if (slot != DIRCACHE_MISS) {
+      dircache_load(slot, first);   // dircache_count records from record first
+      ...
+    }
+    else {
+      scan the directory into records first onwards, and sort them
+      dircache_store(kind, first, count, flags);
+    }
+*/
+
+#define DIRCACHE_DISK_IMAGES 1
+#define DIRCACHE_ROMS 2
+
+#define DIRCACHE_MISS 0xff
+
+#define DIRCACHE_MAGIC_ADDRESS (ATTIC_DIRCACHE_ADDRESS + 0x0000)
+#define DIRCACHE_CLOCK_ADDRESS (ATTIC_DIRCACHE_ADDRESS + 0x0004)
+#define DIRCACHE_TABLE_ADDRESS (ATTIC_DIRCACHE_ADDRESS + 0x0100)
+#define DIRCACHE_INDEX_ADDRESS (ATTIC_DIRCACHE_ADDRESS + 0x1000)
+#define DIRCACHE_RECORDS_ADDRESS (ATTIC_DIRCACHE_ADDRESS + 0x10000)
+#define DIRCACHE_SLOTS 15
+#define DIRCACHE_SLOT_RECORDS DIRLIST_MAX_ENTRIES
+#define dircache_records_address(slot) (DIRCACHE_RECORDS_ADDRESS + ((long)(slot) << 16))
+#define dircache_index_address(slot) (DIRCACHE_INDEX_ADDRESS + ((long)(slot) << 11))
+
+struct dircache_slot {
+  uint32_t cluster;
+  unsigned char kind; // 0 = unused
+  unsigned char flags;
+  unsigned short count;
+  unsigned short entries; // raw directory entries, up to the end marker
+  unsigned short checksum;
+  unsigned short age;
+  unsigned char reserved[2];
+};
+
+// Set by dircache_lookup() on a hit
+extern unsigned short dircache_count;
+extern unsigned char dircache_flags;
+
+unsigned char dircache_lookup(unsigned char kind);
+void dircache_load(unsigned char slot, unsigned short first);
+void dircache_store(unsigned char kind, unsigned short first, unsigned short count, unsigned char flags);
+
+#endif /* __FREEZER_DIRCACHE_H__ */
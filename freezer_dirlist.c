@@ -0,0 +1,129 @@
+/*
+  Sorted directory listings for the disk chooser and the ROM loader.
+
+  See freezer_dirlist.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "fdisk_memory.h"
+#include "freezer_prof.h"
+#include "freezer_dirlist.h"
+
+unsigned short dirlist_index[DIRLIST_MAX_ENTRIES];
+
+// While sorting, the record being placed is kept whole in the upper half of
+// lburst_buffer, and the records it is compared with are fetched into the
+// lower half, a prefix at a time, as most names differ in the first few
+// characters.
+#define DIRLIST_PREFIX 16
+#define dirlist_a (lburst_buffer)
+#define dirlist_b (lburst_buffer + DIR_RECORD_SIZE)
+
+// clang-format off
+static unsigned short dirlist_gaps[] = { 701, 301, 132, 57, 23, 10, 4, 1 };
+// clang-format on
+
+void dirlist_reset(unsigned short count)
+{
+  // Listing in the order of the records
+  unsigned short i;
+
+  for (i = 0; i < count; i++)
+    dirlist_index[i] = i;
+}
+
+static signed char dirlist_compare(unsigned short record)
+{
+  // Compare record with the one in dirlist_b.
+  // Directories go first, then names in case-insensitive order.
+  unsigned char i, a, b;
+
+  lcopy(dir_record_address(record), (long)dirlist_a, DIRLIST_PREFIX);
+
+  a = dirlist_a[0] == '/';
+  b = dirlist_b[0] == '/';
+  if (a != b)
+    return b - a;
+
+  for (i = 0; i < DIR_RECORD_SIZE; i++) {
+    if (i == DIRLIST_PREFIX)
+      lcopy(dir_record_address(record) + DIRLIST_PREFIX, (long)dirlist_a + DIRLIST_PREFIX,
+          DIR_RECORD_SIZE - DIRLIST_PREFIX);
+    a = dirlist_a[i];
+    b = dirlist_b[i];
+    if (a >= 'a' && a <= 'z')
+      a -= 0x20;
+    if (b >= 'a' && b <= 'z')
+      b -= 0x20;
+    if (a != b)
+      return a < b ? -1 : 1;
+  }
+  return 0;
+}
+
+void dirlist_sort(unsigned short first, unsigned short count)
+{
+  // Shell sort of lines first to first+count-1 of the listing.
+  // Only dirlist_index[] changes, the records stay where they are.
+  unsigned short i, j, gap, record, end = first + count;
+  unsigned char g;
+
+  for (g = 0; g < sizeof(dirlist_gaps) / sizeof(dirlist_gaps[0]); g++) {
+    gap = dirlist_gaps[g];
+    if (gap >= count)
+      continue;
+    for (i = first + gap; i < end; i++) {
+      record = dirlist_index[i];
+      lcopy(dir_record_address(record), (long)dirlist_b, DIR_RECORD_SIZE);
+      for (j = i; j >= first + gap && dirlist_compare(dirlist_index[j - gap]) > 0; j -= gap)
+        dirlist_index[j] = dirlist_index[j - gap];
+      dirlist_index[j] = record;
+    }
+  }
+}
+
+#ifdef WITH_PROFILING
+unsigned char dirlist_benchmark(void)
+{
+  // Sort 1000 made up entries (about one in eight a directory, mixed case
+  // names) under PROF_DIR_SORT, and check the result.
+  // Returns 1 if they came out in order.
+  // NOTE: This overwrites the records at $40000
+  unsigned short n, seed = 0xace1;
+  unsigned char i, len;
+
+  for (n = 0; n < 1000; n++) {
+    lfill((long)lburst_buffer, ' ', DIR_RECORD_SIZE);
+    len = 4 + (seed & 15);
+    for (i = 0; i < len; i++) {
+      // 16-bit xorshift
+      seed ^= seed << 7;
+      seed ^= seed >> 9;
+      seed ^= seed << 8;
+      lburst_buffer[i] = ((seed >> 8) & 1 ? 'A' : 'a') + (seed % 26);
+    }
+    if (!(seed & 0x70))
+      lburst_buffer[0] = '/';
+    else {
+      lburst_buffer[len + 0] = '.';
+      lburst_buffer[len + 1] = 'D';
+      lburst_buffer[len + 2] = '8';
+      lburst_buffer[len + 3] = '1';
+    }
+    lburst_write(dir_record_address(n), DIR_RECORD_SIZE);
+  }
+
+  dirlist_reset(1000);
+  PROF_BEGIN(PROF_DIR_SORT);
+  dirlist_sort(0, 1000);
+  PROF_END(PROF_DIR_SORT);
+
+  for (n = 1; n < 1000; n++) {
+    lcopy(dir_record(n), (long)dirlist_b, DIR_RECORD_SIZE);
+    if (dirlist_compare(dirlist_index[n - 1]) > 0)
+      return 0;
+  }
+  return 1;
+}
+#endif
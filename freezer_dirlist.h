@@ -0,0 +1,35 @@
+#ifndef __FREEZER_DIRLIST_H__
+#define __FREEZER_DIRLIST_H__
+
+/*
+  Sorted directory listings for the disk chooser and the ROM loader.
+
+  The listing is a table of 64 byte records at $40000, one per entry, with
+  directories marked by a leading '/'. Rather than moving records around in
+  far memory, they are put in order through dirlist_index[], which holds the
+  record number of each line of the listing. Use dir_record(n) to get the
+  address of the record shown on line n.
+*/
+
+#define DIR_RECORDS_ADDRESS 0x40000L
+#define DIR_RECORD_SIZE 64
+#define dir_record_address(record) (DIR_RECORDS_ADDRESS + ((long)(record) << 6))
+#define dir_record(n) dir_record_address(dirlist_index[n])
+
+// Stay below the thumbnail at $50000 (and fit a directory cache slot).
+// The ROM loader lists at most this many entries of a directory, taking them
+// in the order the directory has them, and silently leaves out the rest,
+// before sorting (so even /ROMS might be missing from a very big directory).
+// The disk chooser pages bigger directories in and out instead.
+#define DIRLIST_MAX_ENTRIES 1023
+
+extern unsigned short dirlist_index[DIRLIST_MAX_ENTRIES];
+
+void dirlist_reset(unsigned short count);
+void dirlist_sort(unsigned short first, unsigned short count);
+
+#ifdef WITH_PROFILING
+unsigned char dirlist_benchmark(void);
+#endif
+
+#endif /* __FREEZER_DIRLIST_H__ */
@@ -0,0 +1,96 @@
+/*
+  Reading part of a file from the SD card.
+
+  See freezer_file.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "freezer.h"
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "freezer_file.h"
+
+#define FILE_CLOSED 0xff
+
+static unsigned char file_fd = FILE_CLOSED;
+// Where we are in the file, and in the sector that is in the sector buffer
+static uint32_t file_position;
+static unsigned short file_offset, file_bytes;
+
+static unsigned char file_next_sector(void)
+{
+  file_offset = 0;
+  file_bytes = readfile(file_fd);
+  return file_bytes != 0;
+}
+
+unsigned char file_open(char* name)
+{
+  file_close();
+  file_fd = openfile(name);
+  if (file_fd == FILE_CLOSED)
+    return 1;
+  file_position = 0;
+  file_offset = file_bytes = 0;
+  return 0;
+}
+
+unsigned char file_seek(uint32_t offset)
+{
+  // Only forwards, a sector at a time, leaving the sectors where they are
+  if (file_fd == FILE_CLOSED || offset < file_position)
+    return 1;
+  while (offset - file_position >= file_bytes - file_offset) {
+    file_position += file_bytes - file_offset;
+    if (!file_next_sector())
+      return offset != file_position;
+  }
+  file_offset += offset - file_position;
+  file_position = offset;
+  return 0;
+}
+
+unsigned short file_read(uint32_t address, unsigned short length)
+{
+  unsigned short done = 0, n;
+
+  if (file_fd == FILE_CLOSED)
+    return 0;
+
+  // Make sure the SD card sector buffer is visible, not the floppy one
+  // ($D689 bit 7 set)
+  POKE(0xD689U, PEEK(0xD689U) | 0x80);
+
+  while (done < length) {
+    if (file_offset == file_bytes && !file_next_sector())
+      break;
+    n = file_bytes - file_offset;
+    if (n > length - done)
+      n = length - done;
+    lcopy(0xffd6e00L + file_offset, address + done, n);
+    file_offset += n;
+    done += n;
+  }
+  file_position += done;
+  return done;
+}
+
+void file_close(void)
+{
+  if (file_fd != FILE_CLOSED)
+    closefile(file_fd);
+  file_fd = FILE_CLOSED;
+}
+
+unsigned short file_load(char* name, uint32_t offset, uint32_t address, unsigned short length)
+{
+  unsigned short got = 0;
+
+  if (file_open(name))
+    return 0;
+  if (!file_seek(offset))
+    got = file_read(address, length);
+  file_close();
+  return got;
+}
@@ -0,0 +1,40 @@
+#ifndef __FREEZER_FILE_H__
+#define __FREEZER_FILE_H__
+
+/*
+  Reading part of a file from the SD card.
+
+  read_file_from_sdcard() has the hypervisor load the whole of a file, when
+  often only a little of it is wanted: the 4KB font out of the 128KB of
+  MEGA65.ROM, or the version string at the start of a utility. This reads a
+  file a sector at a time instead, through the hypervisor file descriptor
+  traps, and copies just the bytes asked for to anywhere in the 28-bit
+  address space:
+
+    if (!file_open(name)) {
+      file_seek(offset);
+      got = file_read(address, length);
+      file_close();
+    }
+
+  or, all in one go, got = file_load(name, offset, address, length).
+
+  Only one file can be open at a time. The data comes through the SD card
+  sector buffer, so nothing else may use the SD card while the file is open.
+  Seeking only goes forwards, skipping whole sectors without copying them,
+  as not every hypervisor version can seek.
+
+  To find out whether a file is there at all, file_open() it (a single
+  hypervisor lookup) and file_close() it again. For its size and where it
+  is on the card, see freezer_stat.h.
+*/
+
+// These return 0 on success, like read_file_from_sdcard()
+unsigned char file_open(char* name);
+unsigned char file_seek(uint32_t offset);
+// These return the number of bytes read, which is less at the end of the file
+unsigned short file_read(uint32_t address, unsigned short length);
+unsigned short file_load(char* name, uint32_t offset, uint32_t address, unsigned short length);
+void file_close(void);
+
+#endif /* __FREEZER_FILE_H__ */
@@ -0,0 +1,80 @@
+/*
+  State handed from one freezer tool to the next.
+
+  See freezer_handoff.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freezer.h"
+#include "freezer_common.h"
+#include "fdisk_memory.h"
+#include "freezer_handoff.h"
+
+unsigned char handoff_valid = 0;
+
+static unsigned char handoff_magic[4] = { 'H', 'A', 'N', 'D' };
+static struct handoff_block handoff;
+
+unsigned char handoff_take(void)
+{
+  handoff_valid = 0;
+
+  lcopy(HANDOFF_MAGIC_ADDRESS, (long)lburst_buffer, 4);
+  if (memcmp(lburst_buffer, handoff_magic, 4))
+    return 0;
+  lcopy(HANDOFF_BLOCK_ADDRESS, (long)&handoff, sizeof(handoff));
+  if (handoff.version != HANDOFF_VERSION || handoff.armed != handoff.generation)
+    return 0;
+
+  // Nobody else gets it
+  handoff.armed = handoff.generation - 1;
+  lcopy((long)&handoff, HANDOFF_BLOCK_ADDRESS, sizeof(handoff));
+
+  if (handoff.valid & HANDOFF_SLOT) {
+    freeze_slot_start_sector = handoff.slot_start_sector;
+    freeze_region_count = handoff.region_count;
+    freeze_region_flags = handoff.region_flags;
+    lcopy(HANDOFF_REGIONS_ADDRESS, (long)&freeze_region_list, sizeof(freeze_region_list));
+  }
+  if (handoff.valid & HANDOFF_ROM) {
+    mega65_rom_type = handoff.rom_type;
+    memcpy(mega65_rom_name, handoff.rom_name, sizeof(handoff.rom_name));
+  }
+  handoff_valid = handoff.valid;
+  return handoff_valid;
+}
+
+void handoff_give(void)
+{
+  // Start from the generation already there, if there is one
+  lcopy(HANDOFF_MAGIC_ADDRESS, (long)lburst_buffer, 4);
+  if (memcmp(lburst_buffer, handoff_magic, 4))
+    handoff.generation = 0;
+  else
+    lcopy(HANDOFF_BLOCK_ADDRESS, (long)&handoff, sizeof(handoff));
+
+  handoff.version = HANDOFF_VERSION;
+  handoff.valid = handoff_valid;
+  if (slot_number)
+    handoff.valid &= ~(HANDOFF_SLOT | HANDOFF_ROM);
+  handoff.generation++;
+  handoff.armed = handoff.generation;
+
+  handoff.slot_start_sector = freeze_slot_start_sector;
+  handoff.region_count = freeze_region_count;
+  handoff.region_flags = freeze_region_flags;
+  lcopy((long)&freeze_region_list, HANDOFF_REGIONS_ADDRESS, sizeof(freeze_region_list));
+  handoff.rom_type = mega65_rom_type;
+  memcpy(handoff.rom_name, mega65_rom_name, sizeof(handoff.rom_name));
+
+  lcopy((long)&handoff, HANDOFF_BLOCK_ADDRESS, sizeof(handoff));
+  lcopy((long)handoff_magic, HANDOFF_MAGIC_ADDRESS, 4);
+}
+
+void handoff_cancel(void)
+{
+  // The next tool didn't start after all, so nobody may take the block
+  lfill(HANDOFF_MAGIC_ADDRESS, 0, 4);
+}
@@ -0,0 +1,59 @@
+#ifndef __FREEZER_HANDOFF_H__
+#define __FREEZER_HANDOFF_H__
+
+/*
+  State handed from one freezer tool to the next.
+
+  Every tool starts by setting the palette, asking the hypervisor where
+  freeze slot 0 starts and for the freeze region list, and some of them
+  read the ROM version out of the slot, although the tool that started it
+  has just done all of that. So before starting another tool, a tool calls
+  handoff_give(), which puts what it knows into a block in attic RAM, and
+  the new tool calls handoff_take() first thing, and only works out what
+  wasn't in it.
+
+  handoff_valid says what is known (HANDOFF_*). A tool sets a bit when it
+  has worked that out itself, and clears it when it might have changed it
+  (e.g., the ROM loader clears HANDOFF_ROM). The block describes slot 0,
+  and so handoff_give() leaves the slot and the ROM out when a different
+  slot is selected.
+
+  The block can only be taken once, by the tool started right after it was
+  given: handoff_give() counts up the generation, and arms the block for
+  it, and handoff_take() disarms it again. So the freezer, when it is
+  started for a new freeze, always starts from scratch. If toolcache_exec()
+  returns, the tool wasn't started, and handoff_cancel() throws the block
+  away, so that whichever tool is started next doesn't trust it.
+*/
+
+#define HANDOFF_VERSION 1
+
+#define HANDOFF_MAGIC_ADDRESS (ATTIC_HANDOFF_ADDRESS + 0x0000)
+#define HANDOFF_BLOCK_ADDRESS (ATTIC_HANDOFF_ADDRESS + 0x0004)
+#define HANDOFF_REGIONS_ADDRESS (ATTIC_HANDOFF_ADDRESS + 0x0100)
+
+#define HANDOFF_PALETTE 0x01 // set_palette() has been done
+#define HANDOFF_SLOT 0x02 // freeze_slot_start_sector and the freeze region list, for slot 0
+#define HANDOFF_ROM 0x04 // mega65_rom_type and mega65_rom_name, for slot 0
+
+struct handoff_block {
+  unsigned char version;
+  unsigned char valid;
+  unsigned short generation;
+  unsigned short armed; // generation this block can be taken in
+  uint32_t slot_start_sector;
+  unsigned char region_count;
+  unsigned char region_flags;
+  char rom_type;
+  char rom_name[12];
+};
+
+extern unsigned char handoff_valid;
+
+// Returns handoff_valid
+unsigned char handoff_take(void);
+void handoff_give(void);
+// After handoff_give(), if the next tool could not be started
+void handoff_cancel(void);
+
+#endif /* __FREEZER_HANDOFF_H__ */
@@ -0,0 +1,344 @@
+/*
+  Directory preview of disk images, without mounting them.
+
+  See freezer_preview.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freezer_common.h"
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_fat32.h"
+#include "freezer_preview.h"
+
+unsigned char preview_page[PREVIEW_ROWS * PREVIEW_COLS];
+unsigned char preview_rows;
+
+static unsigned char preview_type;
+static uint32_t image_cluster, image_size;
+
+// Where we got to along the cluster chain of the image, so that reading on
+// from there doesn't have to start from the beginning again
+static uint32_t chain_cluster;
+static unsigned short chain_index;
+
+// Give up on directories that go round in circles
+#define PREVIEW_MAX_DIR_BLOCKS 40
+
+static unsigned char preview_magic[4] = { 'P', 'R', 'E', 'V' };
+
+// The slot table lives in lburst_buffer while we work on it
+#define preview_slots ((struct preview_slot*)lburst_buffer)
+
+static void preview_read_table(void)
+{
+  lcopy(PREVIEW_MAGIC_ADDRESS, (long)lburst_buffer, 4);
+  if (memcmp(lburst_buffer, preview_magic, 4)) {
+    // Nothing (valid) there yet
+    lfill(ATTIC_PREVIEW_ADDRESS, 0, 0x200);
+    lcopy((long)preview_magic, PREVIEW_MAGIC_ADDRESS, 4);
+  }
+  lburst_read(PREVIEW_TABLE_ADDRESS, PREVIEW_SLOTS * sizeof(struct preview_slot));
+}
+
+static unsigned short preview_tick(void)
+{
+  // Age counter for replacing the least recently used slot
+  unsigned short clock;
+
+  lcopy(PREVIEW_CLOCK_ADDRESS, (long)&clock, 2);
+  clock++;
+  lcopy((long)&clock, PREVIEW_CLOCK_ADDRESS, 2);
+  return clock;
+}
+
+static unsigned char* image_block(unsigned short block)
+{
+  // Read 256 byte block of the image, and return where it is in
+  // sector_buffer, or NULL if it isn't there.
+  unsigned short sector = block >> 1;
+  unsigned short index = sector / sectors_per_cluster;
+
+  if (((uint32_t)block << 8) >= image_size)
+    return NULL;
+
+  if (index < chain_index) {
+    chain_index = 0;
+    chain_cluster = image_cluster;
+  }
+  while (chain_index < index) {
+    chain_cluster = fat32_follow_cluster(chain_cluster) & 0x0fffffffUL;
+    if (chain_cluster < 2 || chain_cluster >= FAT32_END_OF_CHAIN) {
+      chain_index = 0;
+      chain_cluster = image_cluster;
+      return NULL;
+    }
+    chain_index++;
+  }
+
+  sdcard_readsector(fat32_cluster_sector(chain_cluster) + (sector & (sectors_per_cluster - 1)));
+  return &sector_buffer[(block & 1) << 8];
+}
+
+static unsigned short image_track_block(unsigned char track, unsigned char sector)
+{
+  // Block number of a track (from 1) and sector (from 0)
+  unsigned short block = 0;
+
+  if (preview_type == PREVIEW_D81)
+    return (track - 1) * 40 + sector;
+  if (preview_type == PREVIEW_D65)
+    return ((track - 1) << 8) + sector;
+
+  // D64 zones (the second side of a D71 is the same again)
+  if (track > 35 && preview_type == PREVIEW_D71) {
+    track -= 35;
+    block = 683;
+  }
+  if (track < 18)
+    return block + (track - 1) * 21 + sector;
+  if (track < 25)
+    return block + 357 + (track - 18) * 19 + sector;
+  if (track < 31)
+    return block + 490 + (track - 25) * 18 + sector;
+  return block + 598 + (track - 31) * 17 + sector;
+}
+
+static void preview_open(uint32_t cluster, uint32_t size)
+{
+  image_cluster = chain_cluster = cluster;
+  chain_index = 0;
+  image_size = size;
+}
+
+// Fletcher style sum of the blocks read by preview_check()
+static unsigned char check_sum1, check_sum2, check_ok;
+
+static unsigned char* preview_sum(unsigned short block)
+{
+  unsigned char* b = image_block(block);
+  unsigned char i = 0;
+
+  if (!b) {
+    check_ok = 0;
+    return NULL;
+  }
+  do {
+    check_sum1 += b[i];
+    check_sum2 += check_sum1;
+  } while (++i);
+  return b;
+}
+
+static unsigned short preview_check(void)
+{
+  // Sum of the header, the BAM and the first directory block. Saving to a
+  // mounted image changes these in place, without moving the image or
+  // changing its size.
+  unsigned char* b;
+  unsigned char track = 18;
+
+  check_sum1 = check_sum2 = 0;
+  check_ok = 1;
+  if (preview_type >= PREVIEW_D81) {
+    track = 40;
+    preview_sum(image_track_block(40, 1));
+    preview_sum(image_track_block(40, 2));
+  }
+  b = preview_sum(image_track_block(track, 0));
+  if (b && b[0])
+    preview_sum(image_track_block(b[0], b[1]));
+  return check_sum1 | (check_sum2 << 8);
+}
+
+static unsigned char preview_find(uint32_t cluster, uint32_t size)
+{
+  // Slot with the page of the image in it, or PREVIEW_SLOTS
+  unsigned char slot;
+
+  preview_read_table();
+  for (slot = 0; slot < PREVIEW_SLOTS; slot++)
+    if (preview_slots[slot].cluster == cluster && preview_slots[slot].size == size)
+      break;
+  return slot;
+}
+
+static unsigned char preview_use(unsigned char slot)
+{
+  preview_read_table();
+  preview_rows = preview_slots[slot].rows;
+  preview_type = preview_slots[slot].type;
+  preview_slots[slot].age = preview_tick();
+  lburst_write(PREVIEW_TABLE_ADDRESS, PREVIEW_SLOTS * sizeof(struct preview_slot));
+  lcopy(preview_page_address(slot), (long)preview_page, sizeof(preview_page));
+  return preview_type;
+}
+
+unsigned char preview_lookup(uint32_t cluster, uint32_t size)
+{
+  // Only the cache, without reading anything from the SD card
+  unsigned char slot;
+
+  if (!cluster)
+    return 0;
+  slot = preview_find(cluster, size);
+  if (slot == PREVIEW_SLOTS)
+    return 0;
+  return preview_use(slot);
+}
+
+static void preview_store(unsigned short check)
+{
+  // Keep the page just rendered, in place of an out of date one of the same
+  // image if there is one, else of the least recently used one
+  unsigned char slot, victim = 0;
+
+  preview_read_table();
+  for (slot = 1; slot < PREVIEW_SLOTS; slot++)
+    if (preview_slots[slot].age < preview_slots[victim].age)
+      victim = slot;
+  for (slot = 0; slot < PREVIEW_SLOTS; slot++)
+    if (preview_slots[slot].cluster == image_cluster && preview_slots[slot].size == image_size)
+      victim = slot;
+
+  preview_slots[victim].cluster = image_cluster;
+  preview_slots[victim].size = image_size;
+  preview_slots[victim].type = preview_type;
+  preview_slots[victim].rows = preview_rows;
+  preview_slots[victim].check = check;
+  preview_slots[victim].age = preview_tick();
+  lburst_write(PREVIEW_TABLE_ADDRESS, PREVIEW_SLOTS * sizeof(struct preview_slot));
+  lcopy((long)preview_page, preview_page_address(victim), sizeof(preview_page));
+}
+
+static void preview_name(unsigned char row, unsigned char* name, unsigned char trim)
+{
+  // 16 character PETSCII name in quotes
+  unsigned char* p = &preview_page[row * PREVIEW_COLS];
+  unsigned char i;
+
+  p[0] = '"';
+  for (i = 0; i < 16; i++)
+    p[i + 1] = petscii_to_screen(name[i]);
+  p[17] = '"';
+  if (trim) {
+    for (i = 16; (p[i] & 0xbf) == ' ' && i > 1; i--) // this might be 0x20 or 0x60
+      p[i + 1] = ' ';
+    p[i + 1] = '"';
+  }
+}
+
+static void preview_blocks_free(unsigned short blocks)
+{
+  unsigned char* p = &preview_page[preview_rows * PREVIEW_COLS];
+  unsigned char digits[5], i = 0, j;
+  static char blocks_free[] = " BLOCKS FREE.";
+
+  do {
+    digits[i++] = '0' + blocks % 10;
+    blocks /= 10;
+  } while (blocks);
+  for (j = 0; i; j++)
+    p[j] = digits[--i];
+  for (i = 0; blocks_free[i]; i++)
+    p[j + i] = petscii_to_screen(blocks_free[i]);
+  preview_rows++;
+}
+
+unsigned char preview_render(uint32_t cluster, uint32_t size)
+{
+  // Preview of an image file, from the cache or straight off the SD card
+  unsigned char slot;
+  unsigned short check;
+
+  if (size == 174848UL || size == 175531UL || size == 196608UL || size == 197376UL)
+    preview_type = PREVIEW_D64;
+  else if (size == 349696UL || size == 351062UL)
+    preview_type = PREVIEW_D71;
+  else if (size == 819200UL || size == 822400UL)
+    preview_type = PREVIEW_D81;
+  else if (size == 85 * 64 * 2 * 512UL)
+    preview_type = PREVIEW_D65;
+  else
+    return 0;
+  if (!sectors_per_cluster || cluster < 2 || cluster >= FAT32_END_OF_CHAIN)
+    return 0;
+
+  // The cached page is only good if the image hasn't been written to since
+  preview_open(cluster, size);
+  check = preview_check();
+  if (!check_ok)
+    return 0;
+  slot = preview_find(cluster, size);
+  if (slot != PREVIEW_SLOTS && preview_slots[slot].check == check)
+    return preview_use(slot);
+
+  if (!preview_parse(preview_type, image_block))
+    return 0;
+  preview_store(check);
+  return preview_type;
+}
+
+unsigned char preview_parse(unsigned char type, preview_reader_t read_block)
+{
+  unsigned char *b, track, sector, i, hops, tracks, first;
+  unsigned short blocks = 0;
+  struct cbm_dirent* d;
+
+  preview_type = type;
+  preview_rows = 0;
+  memset(preview_page, ' ', sizeof(preview_page));
+
+  // Header, with the disk name and the link to the first directory block
+  b = read_block(preview_type >= PREVIEW_D81 ? image_track_block(40, 0) : image_track_block(18, 0));
+  if (!b)
+    return 0;
+  preview_name(0, b + (preview_type >= PREVIEW_D81 ? 0x04 : 0x90), 0);
+  preview_rows = 1;
+  track = b[0];
+  sector = b[1];
+
+  // Free blocks, not counting the directory track
+  if (preview_type >= PREVIEW_D81) {
+    // Each BAM block has the counts for 40 tracks, so follow the chain from
+    // 40/1 until every track of the image is counted or the BAM ends
+    tracks = preview_type == PREVIEW_D65 ? 85 : 80;
+    hops = 1;
+    for (first = 1; first <= tracks; first += 40) {
+      b = read_block(image_track_block(40, hops));
+      if (!b)
+        return 0;
+      for (i = 0; i < 40 && first + i <= tracks; i++)
+        if (first + i != 40)
+          blocks += b[0x10 + i * 6];
+      if (b[0] != 40)
+        break;
+      hops = b[1];
+    }
+  }
+  else {
+    for (i = 0; i < 35; i++)
+      if (i != 17) {
+        blocks += b[0x04 + (i << 2)];
+        if (preview_type == PREVIEW_D71)
+          blocks += b[0xdd + i];
+      }
+  }
+
+  // Then as much of the directory as fits
+  for (hops = 0; track && hops < PREVIEW_MAX_DIR_BLOCKS && preview_rows < PREVIEW_ROWS - 1; hops++) {
+    d = (struct cbm_dirent*)read_block(image_track_block(track, sector));
+    if (!d)
+      break;
+    track = d[0].next_track;
+    sector = d[0].next_sector;
+    for (i = 0; i < 8 && preview_rows < PREVIEW_ROWS - 1; i++)
+      if (d[i].type)
+        preview_name(preview_rows++, d[i].name, 1);
+  }
+
+  preview_blocks_free(blocks);
+  return preview_type;
+}
@@ -0,0 +1,94 @@
+#ifndef __FREEZER_PREVIEW_H__
+#define __FREEZER_PREVIEW_H__
+
+/*
+  Directory preview of disk images, without mounting them.
+
+  The disk chooser keeps the start cluster and size of each image file in
+  its record, from which any 256 byte block of the image can be found by
+  following the FAT32 cluster chain, and read straight off the SD card. So
+  rather than attaching the image and spinning up the virtual floppy drive,
+  preview_render() reads the header, BAM and directory blocks directly, and
+  renders them into preview_page[]: the title on row 0, then the entries,
+  then the number of free blocks.
+
+  The parsing itself is done by preview_parse(), which gets its blocks from
+  a reader function, so the same code serves images read through the
+  floppy controller, and can be tried out on the host with a reader that
+  reads from a file. Directory blocks are taken as arrays of struct
+  cbm_dirent.
+
+  Rendered pages are kept in attic RAM for the PREVIEW_SLOTS most recently
+  previewed images, keyed by start cluster and size, so that going back to
+  an image shows its preview again straight away: preview_lookup() only
+  looks in the cache, and is cheap enough for every key press. But saving
+  to a mounted image writes it in place, at the same size and cluster, so
+  preview_render(), which the disk chooser calls once the selection has
+  stayed put for a while, re-reads the header, BAM and first directory
+  block, and only uses the cached page if they still match the sum kept
+  with it. Otherwise it renders the page again.
+
+  The image type comes from the size of the file:
+
+    D64   35 or 40 tracks of 17-21 sectors, header and BAM on 18/0
+    D71   D64 with a second side of 35 tracks, its free counts also on 18/0
+    D81   80 tracks of 40 sectors, header on 40/0, BAM on 40/1 and 40/2
+    D65   85 tracks of 256 sectors, laid out like a D81, with the BAM
+          carrying on from 40/2 for tracks 81-85 if the image has them
+*/
+
+#define PREVIEW_ROWS 23
+#define PREVIEW_COLS 18
+
+#define PREVIEW_D64 1
+#define PREVIEW_D71 2
+#define PREVIEW_D81 3
+#define PREVIEW_D65 4
+
+#define PREVIEW_MAGIC_ADDRESS (ATTIC_PREVIEW_ADDRESS + 0x0000)
+#define PREVIEW_CLOCK_ADDRESS (ATTIC_PREVIEW_ADDRESS + 0x0004)
+#define PREVIEW_TABLE_ADDRESS (ATTIC_PREVIEW_ADDRESS + 0x0100)
+#define PREVIEW_PAGES_ADDRESS (ATTIC_PREVIEW_ADDRESS + 0x0200)
+#define PREVIEW_SLOTS 16
+#define preview_page_address(slot) (PREVIEW_PAGES_ADDRESS + ((long)(slot) << 9))
+
+// A directory block is 8 of these. The link to the next block is in the
+// first two bytes, i.e., in the first entry.
+struct cbm_dirent {
+  unsigned char next_track;
+  unsigned char next_sector;
+  unsigned char type; // 0 = unused entry
+  unsigned char track;
+  unsigned char sector;
+  unsigned char name[16];
+  unsigned char side_track;
+  unsigned char side_sector;
+  unsigned char record_length;
+  unsigned char unused[6];
+  unsigned short blocks;
+};
+
+// Returns a 256 byte block of the image, or NULL if it can't be read
+typedef unsigned char* (*preview_reader_t)(unsigned short block);
+
+struct preview_slot {
+  uint32_t cluster; // 0 = unused
+  uint32_t size;
+  unsigned short age;
+  unsigned char type;
+  unsigned char rows;
+  unsigned short check; // sum of the header, BAM and first directory block
+  unsigned char reserved[2];
+};
+
+// The rendered preview: screen codes, PREVIEW_COLS per row, preview_rows rows
+extern unsigned char preview_page[PREVIEW_ROWS * PREVIEW_COLS];
+extern unsigned char preview_rows;
+
+// Both return the PREVIEW_xxx type of the image, or 0 if it can't be read
+// (or for preview_lookup(), if it isn't in the cache).
+unsigned char preview_lookup(uint32_t cluster, uint32_t size);
+unsigned char preview_render(uint32_t cluster, uint32_t size);
+unsigned char preview_parse(unsigned char type, preview_reader_t read_block);
+
+#endif /* __FREEZER_PREVIEW_H__ */
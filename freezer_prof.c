@@ -0,0 +1,188 @@
+/*
+  Raster time profiling.
+
+  See freezer_prof.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_screen.h"
+#include "freezer_prof.h"
+
+#ifdef WITH_PROFILING
+
+static unsigned char prof_magic[4] = { 'P', 'R', 'O', 'F' };
+static unsigned char prof_ready = 0;
+static unsigned short prof_head;
+static unsigned char prof_event[4];
+
+static void prof_init(void)
+{
+  // Keep adding to the ring buffer of the previous tool, if there is one
+  lcopy(PROF_MAGIC_ADDRESS, (long)prof_event, 4);
+  if (memcmp(prof_event, prof_magic, 4)) {
+    lfill(PROF_EVENTS_ADDRESS, 0, PROF_RING_EVENTS * 4);
+    prof_head = 0;
+    lcopy((long)&prof_head, PROF_HEAD_ADDRESS, 2);
+    lcopy((long)prof_magic, PROF_MAGIC_ADDRESS, 4);
+  }
+  else
+    lcopy(PROF_HEAD_ADDRESS, (long)&prof_head, 2);
+  prof_ready = 1;
+}
+
+void prof_mark(unsigned char id)
+{
+  unsigned char frame;
+
+  if (!prof_ready)
+    prof_init();
+
+  // Frame counter and raster line, read again if a new frame started in between
+  do {
+    frame = PEEK(0xD7FAU); // frame counter
+    prof_event[1] = frame;
+    prof_event[3] = PEEK(0xD011U) >> 7; // raster line bit 8
+    prof_event[2] = PEEK(0xD012U); // raster line bits 0-7
+  } while (frame != PEEK(0xD7FAU));
+  prof_event[0] = id;
+
+  lcopy((long)prof_event, PROF_EVENTS_ADDRESS + ((long)prof_head << 2), 4);
+  prof_head = (prof_head + 1) & (PROF_RING_EVENTS - 1);
+  lcopy((long)&prof_head, PROF_HEAD_ADDRESS, 2);
+}
+
+// clang-format off
+static char* prof_names[PROF_SECTIONS] = {
+  "", "THUMB", "SCANDIR", "MENU", "SDWRITE", "DIRSORT"
+};
+// clang-format on
+
+static uint32_t prof_count[PROF_SECTIONS], prof_total[PROF_SECTIONS];
+static uint32_t prof_min[PROF_SECTIONS], prof_max[PROF_SECTIONS];
+static unsigned char prof_open[PROF_SECTIONS], prof_start_frame[PROF_SECTIONS];
+static unsigned short prof_start_raster[PROF_SECTIONS];
+static unsigned short prof_lines;
+static char prof_line[43];
+
+static void prof_add(unsigned char* e)
+{
+  unsigned char id = e[0] & ~PROF_END_FLAG;
+  unsigned short raster = e[2] + (e[3] << 8);
+  long lines;
+
+  if (!id || id >= PROF_SECTIONS)
+    return;
+
+  if (!(e[0] & PROF_END_FLAG)) {
+    prof_open[id] = 1;
+    prof_start_frame[id] = e[1];
+    prof_start_raster[id] = raster;
+    return;
+  }
+
+  // (an end without a begin was cut off by the ring buffer wrapping)
+  if (!prof_open[id])
+    return;
+  prof_open[id] = 0;
+
+  lines = (long)(unsigned char)(e[1] - prof_start_frame[id]) * prof_lines + raster - prof_start_raster[id];
+  if (lines < 0)
+    lines += prof_lines;
+
+  if (!prof_count[id] || lines < prof_min[id])
+    prof_min[id] = lines;
+  if (lines > prof_max[id])
+    prof_max[id] = lines;
+  prof_total[id] += lines;
+  prof_count[id]++;
+}
+
+static void prof_scan(unsigned short first, unsigned short last)
+{
+  // Add up entries first to last-1 of the ring buffer, in order
+  unsigned short i, n;
+
+  while (first < last) {
+    n = last - first;
+    if (n > LBURST_BUFFER_SIZE / 4)
+      n = LBURST_BUFFER_SIZE / 4;
+    lburst_read(PROF_EVENTS_ADDRESS + ((long)first << 2), n << 2);
+    for (i = 0; i < n; i++)
+      prof_add(&lburst_buffer[i << 2]);
+    first += n;
+  }
+}
+
+static void prof_hex(char* p, uint32_t v, unsigned char digits)
+{
+  // Values too big for the field show as all F's
+  unsigned char d;
+
+  if (digits < 8 && v >> (digits << 2))
+    v = 0xffffffffUL;
+  for (p += digits; digits; digits--) {
+    d = v & 0xf;
+    *--p = d < 10 ? '0' + d : 'A' + d - 10;
+    v >>= 4;
+  }
+}
+
+static void prof_output(unsigned char row, unsigned char overlay)
+{
+  unsigned char i, c;
+
+  if (overlay) {
+    for (i = 0; i < 40; i++) {
+      c = prof_line[i];
+      lburst_buffer[(i << 1) + 0] = (c >= 'A' && c <= 'Z') ? c - 0x40 : c;
+      lburst_buffer[(i << 1) + 1] = 0;
+    }
+    lburst_write(SCREEN_ADDRESS + row * 80, 80);
+    // Colour RAM has 2 bytes per character, the 2nd holds the colour
+    lfill_stride(0xff80001L + row * 80, COLOUR_YELLOW, 40, 2);
+  }
+
+  prof_line[40] = '\r';
+  prof_line[41] = '\n';
+  prof_line[42] = 0;
+  mega65_serial_monitor_write(prof_line);
+}
+
+void prof_report(unsigned char overlay)
+{
+  // Times are in raster lines, of about 64us each
+  unsigned char id;
+
+  if (!prof_ready)
+    prof_init();
+
+  // $D06F bit 7 is set for NTSC, which has fewer raster lines than PAL
+  prof_lines = (PEEK(0xD06FU) & 0x80) ? 263 : 312;
+  memset(prof_count, 0, sizeof(prof_count));
+  memset(prof_total, 0, sizeof(prof_total));
+  memset(prof_max, 0, sizeof(prof_max));
+  memset(prof_open, 0, sizeof(prof_open));
+
+  // Oldest entries first
+  prof_scan(prof_head, PROF_RING_EVENTS);
+  prof_scan(0, prof_head);
+
+  //                 0123456789012345678901234567890123456789
+  strcpy(prof_line, "SECTION  COUNT  TOTAL   MIN  MAX (LINES)");
+  prof_output(0, overlay);
+  for (id = 1; id < PROF_SECTIONS; id++) {
+    memset(prof_line, ' ', 40);
+    memcpy(prof_line, prof_names[id], strlen(prof_names[id]));
+    prof_hex(&prof_line[9], prof_count[id], 4);
+    prof_hex(&prof_line[15], prof_total[id], 7);
+    prof_hex(&prof_line[23], prof_min[id], 4);
+    prof_hex(&prof_line[28], prof_max[id], 4);
+    prof_output(id, overlay);
+  }
+}
+
+#endif
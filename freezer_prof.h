@@ -0,0 +1,48 @@
+#ifndef __FREEZER_PROF_H__
+#define __FREEZER_PROF_H__
+
+/*
+  Raster time profiling.
+
+  PROF_BEGIN(id) and PROF_END(id) record the frame counter and raster line
+  into a ring buffer in attic RAM, so that sections from all of the tools end
+  up in the same place. prof_report() then adds up the time spent in each
+  section (count, total, min and max, in raster lines), writes that out over
+  the serial monitor interface, and optionally also draws it over the top of
+  the screen.
+
+  Uncomment WITH_PROFILING to use it. Otherwise the markers compile to
+  nothing.
+*/
+
+// #define WITH_PROFILING
+
+// Section ids (0 marks an empty ring buffer entry)
+#define PROF_THUMBNAIL 1
+#define PROF_SCAN_DIRECTORY 2
+#define PROF_DRAW_FREEZE_MENU 3
+#define PROF_SDCARD_WRITE 4
+#define PROF_DIR_SORT 5
+#define PROF_SECTIONS 6
+
+#define PROF_END_FLAG 0x80
+
+// Ring buffer in attic RAM: magic, next entry, then 4 byte entries of
+// section id (| PROF_END_FLAG), frame counter, and raster line (2 bytes)
+#define PROF_MAGIC_ADDRESS (ATTIC_PROF_ADDRESS + 0)
+#define PROF_HEAD_ADDRESS (ATTIC_PROF_ADDRESS + 4)
+#define PROF_EVENTS_ADDRESS (ATTIC_PROF_ADDRESS + 16)
+#define PROF_RING_EVENTS 4096
+
+#ifdef WITH_PROFILING
+#define PROF_BEGIN(id) prof_mark(id)
+#define PROF_END(id) prof_mark((id) | PROF_END_FLAG)
+
+void prof_mark(unsigned char id);
+void prof_report(unsigned char overlay);
+#else
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+#endif
+
+#endif /* __FREEZER_PROF_H__ */
@@ -0,0 +1,114 @@
+/*
+  Frame scheduler and background job queue for the freezer tools.
+
+  See freezer_sched.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "freezer_sched.h"
+#include "fdisk_memory.h"
+
+unsigned short sched_frame_count = 0;
+unsigned short sched_overruns = 0;
+
+static sched_job_t sched_jobs[SCHED_MAX_JOBS];
+static unsigned char sched_job_count = 0;
+static unsigned char sched_next_job = 0;
+
+// Was the raster at or below SCHED_RASTER_LINE when we last looked?
+static unsigned char sched_below = 1;
+
+static unsigned char sched_raster_below(void)
+{
+  // Bit 8 of the raster line is $D011 bit 7
+  return (PEEK(0xD011U) & 0x80) || PEEK(0xD012U) >= SCHED_RASTER_LINE;
+}
+
+void sched_init(void)
+{
+  // Don't count the frame we are in the middle of, if we are below the line
+  sched_below = sched_raster_below();
+
+  sched_job_count = 0;
+  sched_next_job = 0;
+}
+
+unsigned char sched_frame_tick(void)
+{
+  // Returns 1 once per frame, as the raster passes SCHED_RASTER_LINE
+  unsigned char below = sched_raster_below();
+
+  if (below == sched_below)
+    return 0;
+  sched_below = below;
+  if (!below)
+    return 0;
+  sched_frame_count++;
+  return 1;
+}
+
+void sched_wait_frame(void)
+{
+  while (!sched_frame_tick())
+    continue;
+}
+
+unsigned char sched_add(sched_job_t job)
+{
+  unsigned char i;
+
+  // Already queued?
+  for (i = 0; i < sched_job_count; i++)
+    if (sched_jobs[i] == job)
+      return 1;
+
+  if (sched_job_count == SCHED_MAX_JOBS)
+    return 0;
+  sched_jobs[sched_job_count++] = job;
+  return 1;
+}
+
+void sched_cancel(sched_job_t job)
+{
+  unsigned char i;
+
+  for (i = 0; i < sched_job_count; i++)
+    if (sched_jobs[i] == job) {
+      if (i < sched_next_job)
+        sched_next_job--;
+      sched_job_count--;
+      for (; i < sched_job_count; i++)
+        sched_jobs[i] = sched_jobs[i + 1];
+      return;
+    }
+}
+
+void sched_run(void)
+{
+  // Give the rest of this frame to the queued jobs, one slice at a time and
+  // round robin, and return when the next frame starts. Without any queued
+  // jobs, this just waits for the next frame.
+  sched_job_t job;
+
+  while (!sched_frame_tick()) {
+    if (!sched_job_count)
+      continue;
+
+    if (sched_next_job >= sched_job_count)
+      sched_next_job = 0;
+    job = sched_jobs[sched_next_job];
+
+    if (job() == SCHED_DONE)
+      sched_cancel(job);
+    else
+      sched_next_job++;
+
+    // If the frame started while the slice was running, input polling is
+    // late for this frame
+    if (sched_frame_tick()) {
+      sched_overruns++;
+      return;
+    }
+  }
+}
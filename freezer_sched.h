@@ -0,0 +1,49 @@
+#ifndef __FREEZER_SCHED_H__
+#define __FREEZER_SCHED_H__
+
+/*
+  Frame scheduler and background job queue for the freezer tools.
+
+  The tools run with interrupts disabled, so instead of a raster IRQ handler
+  this polls the raster line ($D012, with bit 8 in $D011), and counts a new
+  frame each time it is seen to have passed SCHED_RASTER_LINE (just below the
+  visible area). It doesn't use the raster compare latch in $D019, as the
+  screen setup leaves bit 8 of the compare line set, in $D011 and $D07A,
+  which are VIC-IV hot registers that we don't want to write to. A job slice
+  that takes more than a whole frame makes it miss that frame.
+
+  The main loop of a tool looks like:
+
+    sched_init();
+    while (1) {
+      sched_run();     // background job slices until the next frame starts
+      poll input and handle it
+    }
+
+  A job is a function that does one bounded slice of work per call (e.g.,
+  read one sector), and returns SCHED_MORE until it is finished. Jobs keep
+  their own state in globals, so restarting one is just resetting that state
+  and calling sched_add() again.
+*/
+
+#define SCHED_RASTER_LINE 0xf8
+#define SCHED_MAX_JOBS 4
+
+#define SCHED_DONE 0
+#define SCHED_MORE 1
+
+typedef unsigned char (*sched_job_t)(void);
+
+// Frames seen by the scheduler, and job slices that were still running when
+// a frame started (i.e., that delayed input polling)
+extern unsigned short sched_frame_count;
+extern unsigned short sched_overruns;
+
+void sched_init(void);
+unsigned char sched_frame_tick(void);
+void sched_wait_frame(void);
+unsigned char sched_add(sched_job_t job);
+void sched_cancel(sched_job_t job);
+void sched_run(void);
+
+#endif /* __FREEZER_SCHED_H__ */
@@ -0,0 +1,39 @@
+/*
+  Looking up a file in the current directory.
+
+  See freezer_stat.h for how this fits together.
+*/
+
+#include <stdint.h>
+
+#include "freezer.h"
+#include "fdisk_hal.h"
+#include "fdisk_memory.h"
+#include "fdisk_fat32.h"
+#include "freezer_file.h"
+#include "freezer_stat.h"
+
+unsigned char file_stat(char* name, struct file_stat* st)
+{
+  unsigned char* e;
+
+  st->size = st->cluster = st->modified = 0;
+
+  if (!sectors_per_cluster)
+    fat32_open_file_system();
+  if (!sectors_per_cluster) {
+    // We can't read the directory ourselves, so just ask the hypervisor
+    if (file_open(name))
+      return 1;
+    file_close();
+    return 0;
+  }
+
+  e = fat32_find_entry(fat32_current_dir_cluster(), name);
+  if (!e)
+    return 1;
+  st->size = *(uint32_t*)&e[0x1c];
+  st->modified = *(uint32_t*)&e[0x16];
+  st->cluster = e[0x1a] | ((uint32_t)e[0x1b] << 8) | ((uint32_t)e[0x14] << 16) | ((uint32_t)e[0x15] << 24);
+  return 0;
+}
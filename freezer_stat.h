@@ -0,0 +1,25 @@
+#ifndef __FREEZER_STAT_H__
+#define __FREEZER_STAT_H__
+
+/*
+  Looking up a file in the current directory.
+
+  file_stat() reads the directory entry of a file itself, through
+  fdisk_fat32, which gives its size, start cluster and modification time.
+  If the file system can't be read, it falls back to asking the hypervisor
+  whether the file is there, and leaves the rest 0.
+
+  This is kept apart from freezer_file, so that tools that only read files
+  don't have to link all of fdisk_fat32.
+*/
+
+struct file_stat {
+  uint32_t size;
+  uint32_t cluster;
+  uint32_t modified; // FAT date and time
+};
+
+// Returns 0 if the file exists, and fills in st
+unsigned char file_stat(char* name, struct file_stat* st);
+
+#endif /* __FREEZER_STAT_H__ */
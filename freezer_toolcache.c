@@ -0,0 +1,152 @@
+/*
+  Freezer tools kept in attic RAM.
+
+  See freezer_toolcache.h for how this fits together.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "freezer.h"
+#include "fdisk_memory.h"
+#include "freezer_toolcache.h"
+
+struct toolcache_header toolcache_header;
+
+static unsigned char toolcache_magic[4] = { 'T', 'O', 'O', 'L' };
+
+// DMA job for exec_cached(): copy the tool from attic RAM to $07FF
+// clang-format off
+static unsigned char toolcache_dmalist[18] = {
+  0x0b, 0x80, 0x00, 0x81, 0x00, 0x00,        // F018B, source MB, destination MB
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00,        // copy, count, source address and bank
+  0xff, 0x07, 0x00, 0x00, 0x00, 0x00         // destination address and bank
+};
+// clang-format on
+
+unsigned char toolcache_find(char* name)
+{
+  // Slot with the tool in it, with its header in toolcache_header, or TOOLCACHE_MISS
+  unsigned char slot;
+
+  for (slot = 0; slot < TOOLCACHE_SLOTS; slot++) {
+    lcopy(toolcache_slot_address(slot), (long)&toolcache_header, sizeof(toolcache_header));
+    if (!memcmp(toolcache_header.magic, toolcache_magic, 4) && !strncmp(toolcache_header.name, name, 16))
+      return slot;
+  }
+  return TOOLCACHE_MISS;
+}
+
+unsigned char toolcache_fresh(char* name, unsigned short size, uint32_t cluster, uint32_t modified)
+{
+  // Is the tool cached, from the file as it is now?
+  return toolcache_find(name) != TOOLCACHE_MISS && toolcache_header.size == size
+      && toolcache_header.cluster == cluster && toolcache_header.modified == modified;
+}
+
+static unsigned short toolcache_checksum(unsigned short page, unsigned short size)
+{
+  unsigned char sum1 = 0, sum2 = 0, i, n;
+  long address = toolcache_data_address(page);
+
+  for (; size; address += 256) {
+    // Bytes in this block, with 0 meaning 256
+    n = size < 256 ? size : 0;
+    lburst_read(address, n ? n : 256);
+    i = 0;
+    do {
+      sum1 += lburst_buffer[i];
+      sum2 += sum1;
+    } while (++i != n);
+    size -= n ? n : 256;
+  }
+  return sum1 | (sum2 << 8);
+}
+
+static unsigned short toolcache_end(unsigned char skip)
+{
+  // First page after the data of all the valid slots but one
+  unsigned char slot;
+  unsigned short end = TOOLCACHE_FIRST_PAGE, last;
+
+  for (slot = 0; slot < TOOLCACHE_SLOTS; slot++) {
+    if (slot == skip)
+      continue;
+    lcopy(toolcache_slot_address(slot), (long)&toolcache_header, sizeof(toolcache_header));
+    last = toolcache_header.page + toolcache_pages(toolcache_header.size);
+    if (!memcmp(toolcache_header.magic, toolcache_magic, 4) && last > end)
+      end = last;
+  }
+  return end;
+}
+
+unsigned char toolcache_claim(char* name, unsigned short size)
+{
+  // The slot the tool already has, else an empty one, else the one its name
+  // hashes to. The slot is marked invalid until toolcache_seal(), and
+  // toolcache_header.page says where to put the tool: where it was, if it
+  // still fits there, else after everything else that is cached.
+  unsigned char slot, hash = 0;
+  unsigned short page = 0;
+
+  slot = toolcache_find(name);
+  if (slot != TOOLCACHE_MISS && toolcache_pages(size) <= toolcache_pages(toolcache_header.size))
+    page = toolcache_header.page;
+  if (slot == TOOLCACHE_MISS) {
+    for (slot = 0; slot < TOOLCACHE_SLOTS; slot++) {
+      lcopy(toolcache_slot_address(slot), (long)&toolcache_header, 4);
+      if (memcmp(toolcache_header.magic, toolcache_magic, 4))
+        break;
+    }
+    if (slot == TOOLCACHE_SLOTS) {
+      while (*name)
+        hash += *name++;
+      slot = hash & (TOOLCACHE_SLOTS - 1);
+    }
+  }
+  if (!page) {
+    page = toolcache_end(slot);
+    if (page + toolcache_pages(size) > TOOLCACHE_PAGES) {
+      // Full, so start again from the beginning
+      lfill(ATTIC_TOOLCACHE_ADDRESS, 0, TOOLCACHE_SLOTS << 6);
+      page = TOOLCACHE_FIRST_PAGE;
+    }
+  }
+
+  memset(&toolcache_header, 0, sizeof(toolcache_header));
+  toolcache_header.page = page;
+  lcopy((long)&toolcache_header, toolcache_slot_address(slot), sizeof(toolcache_header));
+  return slot;
+}
+
+void toolcache_seal(unsigned char slot, char* name, unsigned short size, uint32_t cluster, uint32_t modified)
+{
+  lcopy(toolcache_slot_address(slot), (long)&toolcache_header, sizeof(toolcache_header));
+  strncpy(toolcache_header.name, name, 16);
+  toolcache_header.size = size;
+  toolcache_header.checksum = toolcache_checksum(toolcache_header.page, size);
+  toolcache_header.cluster = cluster;
+  toolcache_header.modified = modified;
+  memcpy(toolcache_header.magic, toolcache_magic, 4);
+  lcopy((long)&toolcache_header, toolcache_slot_address(slot), sizeof(toolcache_header));
+}
+
+void toolcache_exec(char* name)
+{
+  unsigned char slot = toolcache_find(name);
+  long address;
+
+  if (slot != TOOLCACHE_MISS && toolcache_checksum(toolcache_header.page, toolcache_header.size) == toolcache_header.checksum) {
+    address = toolcache_data_address(toolcache_header.page);
+    toolcache_dmalist[2] = address >> 20;
+    toolcache_dmalist[7] = toolcache_header.size;
+    toolcache_dmalist[8] = toolcache_header.size >> 8;
+    toolcache_dmalist[9] = address;
+    toolcache_dmalist[10] = address >> 8;
+    toolcache_dmalist[11] = (address >> 16) & 0x0f;
+    // Close all files, as the hypervisor would have done
+    closeall();
+    exec_cached(toolcache_dmalist);
+  }
+  mega65_dos_exechelper(name);
+}
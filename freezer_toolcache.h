@@ -0,0 +1,63 @@
+#ifndef __FREEZER_TOOLCACHE_H__
+#define __FREEZER_TOOLCACHE_H__
+
+/*
+  Freezer tools kept in attic RAM, so that they start without the SD card.
+
+  Going from the freeze menu to a tool and back again means the hypervisor
+  loading two .M65 files of up to 34KB each. Instead, the freezer puts each
+  tool it starts (and itself) into a slot in attic RAM, and from then on
+  toolcache_exec() starts it by DMAing it to $07FF and jumping to $080D,
+  just like the hypervisor's loader would have done. Anything that isn't
+  cached, or whose checksum doesn't match any more, is loaded from the SD
+  card as before.
+
+  A slot is keyed by the file name, and by the start cluster, size and
+  modification time of the file when it was cached. Before starting a tool,
+  the freezer compares those with the directory entry (toolcache_fresh()),
+  so a tool that has been updated on the SD card is cached again. The other
+  tools only ever start the freezer, and trust the checksum for that.
+
+  The slot headers are in a table at the start of ATTIC_TOOLCACHE_ADDRESS,
+  and the tools follow it one after the other, each starting on a 256 byte
+  page. So only as much attic RAM is written to as the tools that have been
+  started take up. If a tool doesn't fit after the others, the cache starts
+  again from the beginning.
+
+  Filling a slot:
+
+    slot = toolcache_claim(name, size);     // the slot is invalid from here
+    load the file to toolcache_data_address(toolcache_header.page)
+    toolcache_seal(slot, name, size, cluster, modified);
+*/
+
+#define TOOLCACHE_SLOTS 8
+#define TOOLCACHE_MISS 0xff
+#define TOOLCACHE_FIRST_PAGE 2 // after the slot table
+#define TOOLCACHE_PAGES 0x800 // 512KB
+#define toolcache_slot_address(slot) (ATTIC_TOOLCACHE_ADDRESS + ((long)(slot) << 6))
+#define toolcache_data_address(page) (ATTIC_TOOLCACHE_ADDRESS + ((long)(page) << 8))
+#define toolcache_pages(size) (((size) + 255) >> 8)
+#define TOOLCACHE_MAX_SIZE 0xff00U
+
+struct toolcache_header {
+  unsigned char magic[4];
+  char name[16];
+  unsigned short size;
+  unsigned short checksum;
+  uint32_t cluster;
+  uint32_t modified;
+  unsigned short page; // where the tool is
+};
+
+// Header of the slot toolcache_find() found
+extern struct toolcache_header toolcache_header;
+
+unsigned char toolcache_find(char* name);
+unsigned char toolcache_fresh(char* name, unsigned short size, uint32_t cluster, uint32_t modified);
+unsigned char toolcache_claim(char* name, unsigned short size);
+void toolcache_seal(unsigned char slot, char* name, unsigned short size, uint32_t cluster, uint32_t modified);
+// Only returns if the tool could be started neither way
+void toolcache_exec(char* name);
+
+#endif /* __FREEZER_TOOLCACHE_H__ */
@@ -12,6 +12,8 @@
 	.export _read_file_from_sdcard
 	.export _get_freeze_slot_count
 	.export _opendir, _readdir, _closedir, _closeall
+	.export _openfile, _readfile, _closefile
+	.export _exec_cached
 	.autoimport	on  ;; needed this for jsr incsp2, incsp6
 	
 	.include "zeropage.inc"
@@ -128,6 +130,42 @@ load_succeeded:
 	jmp $080d
 	rts
 
+	;; void exec_cached(unsigned char *dmalist);
+	;; Start a programme that is already somewhere in memory: the enhanced
+	;; DMA job at dmalist (18 bytes) copies it to $07FF, as the hypervisor
+	;; would have loaded it, and we then jump into it at $080D.
+	;; The DMA job and the routine that runs it are put at $0340, out of the
+	;; way of the copy.
+_exec_cached:
+	sta ptr1
+	stx ptr1+1
+	ldy #17
+@listCopy:
+	lda (ptr1),y
+	sta $0360,y
+	dey
+	bpl @listCopy
+
+	ldx #execcached_routine_end - execcached_routine - 1
+@routineCopy:
+	lda execcached_routine,x
+	sta $0340,x
+	dex
+	bpl @routineCopy
+	jmp $0340
+
+execcached_routine:
+	lda #$00
+	sta $d702
+	sta $d704		; DMA list is in $00xxxxx
+	lda #$03
+	sta $d701
+	lda #$60
+	sta $d705		; triggers enhanced DMA
+	ldz #$00
+	jmp $080d
+execcached_routine_end:
+
 attachHyppoCmd:
 	.byte	$40
 
@@ -415,6 +453,77 @@ _closeall:
 
 	rts
 	
+	;; openfile takes a pointer to the file name, and returns the file
+	;; descriptor, or $FF if the file couldn't be found or opened.
+	;; As with read_file_from_sdcard, the name goes via $0400.
+_openfile:
+	sta ptr1
+	stx ptr1+1
+
+	;; Copy file name
+	ldy #0
+@NameCopyLoop:
+	lda (ptr1),y
+	sta $0400,y
+	iny
+	cmp #0
+	bne @NameCopyLoop
+
+	;;  Call dos_setname()
+	ldy #>$0400
+	ldx #<$0400
+	lda #$2E     		; dos_setname Hypervisor trap
+	STA $D640		; Do hypervisor trap
+	NOP			; Wasted instruction slot required following hyper trap instruction
+	bcc @openfileError
+
+	lda #$34		; dos_findfile
+	STA $D640
+	NOP
+	bcc @openfileError
+
+	lda #$18		; dos_openfile, returns file descriptor in A
+	STA $D640
+	NOP
+	bcc @openfileError
+	LDX #$00
+	RTS
+
+@openfileError:
+	LDA #$FF
+	LDX #$00
+	RTS
+
+	;; readfile takes the file descriptor as argument, and reads the next
+	;; sector of the file into the SD card sector buffer ($FFD6E00).
+	;; Returns the number of bytes of it that are part of the file, which is
+	;; 0 at the end of the file.
+_readfile:
+	TAX
+	LDA #$1A
+	STA $D640
+	NOP
+	bcc @readfileEnd
+	;; Bytes read come back in X (low) and Y (high)
+	TXA
+	PHY
+	PLX
+	RTS
+
+@readfileEnd:
+	LDA #$00
+	LDX #$00
+	RTS
+
+	;; closefile takes file descriptor as argument (appears in A)
+_closefile:
+	TAX
+	LDA #$20
+	STA $D640
+	NOP
+	LDX #$00
+	RTS
+
 	;; closedir takes file descriptor as argument (appears in A)
 _closedir:
 	TAX
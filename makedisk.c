@@ -12,6 +12,9 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_toolcache.h"
+#include "freezer_handoff.h"
+#include "makedisk_tpl.h"
 
 void setup_menu_screen(void)
 {
@@ -46,73 +49,70 @@ static unsigned short i;
 void draw_box(
     unsigned char x1, unsigned char y1, unsigned char x2, unsigned char y2, unsigned char colour, unsigned char erase)
 {
-  unsigned char x, y;
+  unsigned char x, y, w;
+
+  // Build each kind of row once in lburst_buffer, then DMA it into place
+  w = (x2 - x1 + 1) * 2;
 
   // Clear colour RAM
-  for (x = x1; x <= x2; x++) {
-    for (y = y1; y <= y2; y++) {
-      lpoke(COLOUR_RAM_ADDRESS + y * 80 + x * 2 + 1, colour);
-      lpoke(COLOUR_RAM_ADDRESS + y * 80 + x * 2 + 0, 0);
-    }
+  for (x = 0; x < w; x += 2) {
+    lburst_buffer[x + 0] = 0;
+    lburst_buffer[x + 1] = colour;
   }
+  for (y = y1; y <= y2; y++)
+    lburst_write(COLOUR_RAM_ADDRESS + y * 80 + x1 * 2, w);
 
   if (erase) {
-    for (x = x1 + 1; x < x2; x++) {
-      for (y = y1 + 1; y < y2; y++) {
-        lpoke(SCREEN_ADDRESS + y * 80 + x * 2 + 0, 0x20);
-        lpoke(SCREEN_ADDRESS + y * 80 + x * 2 + 1, 0);
-      }
+    for (x = 0; x < w; x += 2) {
+      lburst_buffer[x + 0] = 0x20;
+      lburst_buffer[x + 1] = 0;
     }
+    for (y = y1 + 1; y < y2; y++)
+      lburst_write(SCREEN_ADDRESS + y * 80 + x1 * 2 + 2, w - 4);
   }
 
-  for (x = x1; x < x2; x++) {
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x * 2, 0x40); // horizontal line, centred
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x * 2 + 1, 0);
-    lpoke(SCREEN_ADDRESS + y2 * 80 + x * 2, 0x40); // horizontal line, centred
-    lpoke(SCREEN_ADDRESS + y2 * 80 + x * 2 + 1, 0);
+  for (x = 0; x < w; x += 2) {
+    lburst_buffer[x + 0] = 0x40; // horizontal line, centred
+    lburst_buffer[x + 1] = 0;
   }
-
-  for (y = y1; y < y2; y++) {
-    lpoke(SCREEN_ADDRESS + y * 80 + x1 * 2, 0x42); // vertical line, centred
-    lpoke(SCREEN_ADDRESS + y * 80 + x1 * 2 + 1, 0);
-    lpoke(SCREEN_ADDRESS + y * 80 + x2 * 2, 0x42); // vertical line, centred
-    lpoke(SCREEN_ADDRESS + y * 80 + x2 * 2 + 1, 0);
+  lburst_buffer[0] = 0x55;    // top left corner
+  lburst_buffer[w - 2] = 73;  // top right corner
+  lburst_write(SCREEN_ADDRESS + y1 * 80 + x1 * 2, w);
+  lburst_buffer[0] = 74;      // bottom left corner
+  lburst_buffer[w - 2] = 75;  // bottom right corner
+  lburst_write(SCREEN_ADDRESS + y2 * 80 + x1 * 2, w);
+
+  lburst_buffer[0] = 0x42; // vertical line, centred
+  for (y = y1 + 1; y < y2; y++) {
+    lburst_write(SCREEN_ADDRESS + y * 80 + x1 * 2, 2);
+    lburst_write(SCREEN_ADDRESS + y * 80 + x2 * 2, 2);
   }
-  lpoke(SCREEN_ADDRESS + y1 * 80 + x1 * 2, 0x55); // top left corner
-  lpoke(SCREEN_ADDRESS + y1 * 80 + x2 * 2, 73);   // top right corner
-  lpoke(SCREEN_ADDRESS + y2 * 80 + x1 * 2, 74);   // bottom left corner
-  lpoke(SCREEN_ADDRESS + y2 * 80 + x2 * 2, 75);   // bottom right corner
-  lpoke(SCREEN_ADDRESS + y1 * 80 + x1 * 2 + 1, 0);
-  lpoke(SCREEN_ADDRESS + y1 * 80 + x2 * 2 + 1, 0);
-  lpoke(SCREEN_ADDRESS + y2 * 80 + x1 * 2 + 1, 0);
-  lpoke(SCREEN_ADDRESS + y2 * 80 + x2 * 2 + 1, 0);
 }
 
-void write_text(unsigned char x1, unsigned char y1, unsigned char colour, char* t)
+// Text is in screen codes, as produced by tools/screenh from templates/makedisk.tpl
+void write_text(unsigned char x1, unsigned char y1, unsigned char colour, unsigned char* t)
 {
-  unsigned char ofs = 0, x, c;
-  for (x = x1; t[x - x1]; x++) {
-    c = t[x - x1];
-    if (c > 0x60)
-      c -= 0x60;
-    if (c > 0x40)
-      c -= 0x40;
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x * 2 + 0, c);
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x * 2 + 1, 0);
-    lpoke(COLOUR_RAM_ADDRESS + y1 * 80 + x * 2 + 0, 0x00);
-    lpoke(COLOUR_RAM_ADDRESS + y1 * 80 + x * 2 + 1, colour);
-  }
+  unsigned char len = strlen((char*)t);
+
+  lcopy_stride((long)t, SCREEN_ADDRESS + y1 * 80 + x1 * 2 + 0, len, 2);
+  lfill_stride(SCREEN_ADDRESS + y1 * 80 + x1 * 2 + 1, 0, len, 2);
+  lfill_stride(COLOUR_RAM_ADDRESS + y1 * 80 + x1 * 2 + 0, 0x00, len, 2);
+  lfill_stride(COLOUR_RAM_ADDRESS + y1 * 80 + x1 * 2 + 1, colour, len, 2);
 }
 
 void input_text(unsigned char x1, unsigned char y1, unsigned char len, unsigned char colour, char* out)
 {
   unsigned char ofs = 0, x, c;
-  for (x = x1; x < (x1 + len); x++) {
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x1 * 2 + 0, ' ');
-    lpoke(SCREEN_ADDRESS + y1 * 80 + x1 * 2 + 1, 0);
-    lpoke(COLOUR_RAM_ADDRESS + y1 * 80 + x1 * 2 + 0, 0x00);
-    lpoke(COLOUR_RAM_ADDRESS + y1 * 80 + x1 * 2 + 1, colour);
+  for (x = 0; x < len * 2; x += 2) {
+    lburst_buffer[x + 0] = ' ';
+    lburst_buffer[x + 1] = 0;
   }
+  lburst_write(SCREEN_ADDRESS + y1 * 80 + x1 * 2, len * 2);
+  for (x = 0; x < len * 2; x += 2) {
+    lburst_buffer[x + 0] = 0x00;
+    lburst_buffer[x + 1] = colour;
+  }
+  lburst_write(COLOUR_RAM_ADDRESS + y1 * 80 + x1 * 2, len * 2);
 
   out[0] = 0;
 
@@ -209,24 +209,89 @@ unsigned char to_hex(unsigned char i)
   return 0x41 + i - 10;
 }
 
-void format_disk_image(unsigned long file_sector, char* diskname, unsigned char isD65)
+// Frames spent creating images, for working out the throughput
+static unsigned long batch_frames;
+static unsigned char batch_frame;
+
+void count_frames(void)
+{
+  // The frame counter is only 8 bits, so add up how far it has moved on
+  // every so often (at least every 5 seconds)
+  unsigned char f = PEEK(0xD7FAU); // frame counter
+  batch_frames += (unsigned char)(f - batch_frame);
+  batch_frame = f;
+}
+
+/*
+  Blank disk templates.
+
+  A new image is a copy of a blank one held in attic RAM, with just its
+  disk name and ID changed. The blank one is BLANK.D81 or BLANK.D65 from the
+  current or the root directory, if there is one (e.g., a formatted GEOS
+  disk), else an empty disk that we put together ourselves.
+*/
+#define TEMPLATE_NONE 0xff
+static unsigned char template_type = TEMPLATE_NONE;
+
+void template_load(unsigned char isD65, unsigned short sect_count, unsigned short header_sector)
 {
-  unsigned char i;
+  unsigned long cluster, size;
+  char* name = isD65 ? "BLANK.D65" : "BLANK.D81";
   unsigned short s;
-  unsigned short sect_count = 80 * 20;
-  if (isD65)
-    sect_count = 85 * 64;
 
-  // Make sure entire image is empty
-  clear_sector_buffer();
-  for (s = 0; s < sect_count; s++) {
-    // XXX - Using multi-sector writes here would be much faster
-    sdcard_writesector(file_sector + s, 0);
-  }
+  if (template_type == isD65)
+    return;
+  template_type = isD65;
+
+  cluster = fat32_find_file(fat32_current_dir_cluster(), name, &size);
+  if (!cluster)
+    cluster = fat32_find_file(root_dir_cluster, name, &size);
+  if (cluster && size >= sect_count * 512L && fat32_read_chain(cluster, ATTIC_TEMPLATE_ADDRESS, sect_count))
+    return;
+
+  // Empty disk, with just the header, BAM and an empty directory
+  for (s = 0; s < sect_count; s += 64)
+    lfill(ATTIC_TEMPLATE_ADDRESS + ((long)s << 9), 0, 0x8000);
 
+  clear_sector_buffer();
   // Link to first directory sector
   sector_buffer[0] = 0x28;
   sector_buffer[1] = 0x03;
+  // DOS type
+  sector_buffer[0x19] = 0x31;
+  sector_buffer[0x1A] = 0x44;
+  lcopy((long)bam_sector1, (long)&sector_buffer[0x100], 0x100);
+  lcopy((long)sector_buffer, ATTIC_TEMPLATE_ADDRESS + ((long)header_sector << 9), 512);
+
+  clear_sector_buffer();
+  lcopy((long)bam_sector1, (long)sector_buffer, 0x100);
+  sector_buffer[0x101] = 0xff;
+  // Link to first sector of dir
+  sector_buffer[0x000] = 0x00;
+  sector_buffer[0x001] = 0xFF;
+  // Mark all sectors free in 2nd half of disk
+  sector_buffer[0x0FA] = 40;
+  sector_buffer[0x0FB] = 0xff;
+  lcopy((long)sector_buffer, ATTIC_TEMPLATE_ADDRESS + ((long)(header_sector + 1) << 9), 512);
+}
+
+void format_disk_image(unsigned long file_sector, char* diskname, unsigned char isD65)
+{
+  unsigned char i, n;
+  unsigned short s;
+  unsigned short sect_count = 80 * 20;
+  unsigned short header_sector = 39 * 10 * 2;
+  long header;
+  if (isD65) {
+    sect_count = 85 * 64;
+    header_sector = 39 * 64 * 2;
+  }
+  header = ATTIC_TEMPLATE_ADDRESS + ((long)header_sector << 9);
+
+  template_load(isD65, sect_count, header_sector);
+
+  // Give the template the name and a random disk ID
+  lcopy(header, (long)sector_buffer, 512);
   // Diskname
   lcopy((long)diskname, (long)&sector_buffer[4], 16);
   if (strlen(diskname) < 16) {
@@ -237,52 +302,52 @@ void format_disk_image(unsigned long file_sector, char* diskname, unsigned char
   i = PEEK(0xD012);
   sector_buffer[0x16] = to_hex(i & 0xf);
   sector_buffer[0x17] = to_hex(i >> 4);
-  // DOS type
-  sector_buffer[0x19] = 0x31;
-  sector_buffer[0x1A] = 0x44;
-
-  lcopy((long)bam_sector1, (long)&sector_buffer[0x100], 0x100);
-
   // Disk ID in BAM
   sector_buffer[0x104] = to_hex(i & 0xf);
   sector_buffer[0x105] = to_hex(i >> 4);
+  lcopy((long)sector_buffer, header, 512);
 
-  if (!isD65)
-    sdcard_writesector(file_sector + (39 * 10 * 2 + 0), 0);
-  else
-    sdcard_writesector(file_sector + (39 * 64 * 2 + 0), 0);
-
-  clear_sector_buffer();
-  lcopy((long)bam_sector1, (long)sector_buffer, 0x100);
-  // Disk ID in BAM
+  lcopy(header + 512, (long)sector_buffer, 512);
   sector_buffer[0x004] = to_hex(i & 0xf);
   sector_buffer[0x005] = to_hex(i >> 4);
-  sector_buffer[0x101] = 0xff;
-  // Link to first sector of dir
-  sector_buffer[0x000] = 0x00;
-  sector_buffer[0x001] = 0xFF;
-  // Mark all sectors free in 2nd half of disk
-  sector_buffer[0x0FA] = 40;
-  sector_buffer[0x0FB] = 0xff;
+  lcopy((long)sector_buffer, header + 512, 512);
 
-  if (!isD65)
-    sdcard_writesector(file_sector + (39 * 10 * 2 + 1), 0);
-  else
-    sdcard_writesector(file_sector + (39 * 64 * 2 + 1), 0);
+  // Then copy it into the file, 64KB at a time
+  for (s = 0; s < sect_count; s += n) {
+    n = (sect_count - s < 128) ? sect_count - s : 128;
+    fat32_write_sectors(file_sector + s, ATTIC_TEMPLATE_ADDRESS + ((long)s << 9), n);
+    count_frames();
+  }
+}
+
+void decimal_text(char* m, unsigned long v)
+{
+  char digits[10];
+  unsigned char n = 0;
+
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n)
+    *m++ = digits[--n];
+  *m = 0;
 }
 
 void do_make_disk_image(unsigned char isD65)
 {
   char diskname[16 + 1];
   char filename[16 + 1];
-  unsigned char filename_len;
-  unsigned short slot_number = 0;
-  unsigned long file_sector;
+  char mount_name[16 + 1];
+  char number[10 + 1];
+  unsigned char filename_len, base_len, count, made;
+  unsigned long file_sector, kb;
+  long size = isD65 ? (85 * 64 * 2 * 512L) : (80 * 10 * 2 * 512L);
 
   fat32_open_file_system();
   if (!fat1_sector) {
     draw_box(10, 8, 30, 13, 2, 1);
-    write_text(11, 9, 7, "COULD NOT FIND SD CARD");
+    write_text(11, 9, 7, no_sdcard_text);
     while (!PEEK(0xD610))
       continue;
     POKE(0xD610, 0);
@@ -290,72 +355,128 @@ void do_make_disk_image(unsigned char isD65)
   }
 
   draw_box(10, 8, 30, 14, 14, 1);
-  write_text(11, 9, 14, "ENTER NAME FOR");
+  write_text(11, 9, 14, enter_name_text);
   if (isD65)
-    write_text(11, 10, 14, "HD (D65) IMAGE:");
+    write_text(11, 10, 14, hd_image_text);
   else
-    write_text(11, 10, 14, "DD (D81) IMAGE:");
+    write_text(11, 10, 14, dd_image_text);
   input_text(11, 12, 8, 1, filename);
-  for (filename_len = 0; filename[filename_len]; filename_len++) {
+  for (base_len = 0; filename[base_len]; base_len++) {
     // Convert to upper case and work out length of string
-    if (filename[filename_len] >= 0x61 && filename[filename_len] <= 0x7a)
-      filename[filename_len] -= 0x20;
+    if (filename[base_len] >= 0x61 && filename[base_len] <= 0x7a)
+      filename[base_len] -= 0x20;
   }
-  if (!filename_len)
+  if (!base_len)
     return;
 
-  // Copy filename into diskname before it gets extended by the filename extension
-  strcpy(diskname, filename);
-
-  filename[filename_len++] = '.';
-  filename[filename_len++] = 0x44;
-  if (isD65) {
-    filename[filename_len++] = 0x36;
-    filename[filename_len++] = 0x35;
-  }
-  else {
-    filename[filename_len++] = 0x38;
-    filename[filename_len++] = 0x31;
-  }
-  filename[filename_len] = 0;
-  lcopy((long)filename, 0x0400, 16);
+  // More than one image makes a batch of numbered ones, NAME01 to NAMEnn
+  write_text(11, 13, 14, count_text);
+  input_text(27, 13, 2, 1, number);
+  count = 0;
+  for (made = 0; number[made] >= '0' && number[made] <= '9'; made++)
+    count = count * 10 + number[made] - '0';
+  if (!count)
+    count = 1;
+  if (count > 1 && base_len > 6)
+    base_len = 6;
 
   draw_box(10, 8, 30, 14, 7, 1);
-  write_text(11, 9, 7, "CREATING IMAGE...");
+  write_text(11, 9, 7, creating_text);
+
+  // Room for the whole batch in one run, so that the images are next to each
+  // other. If there isn't one, they are still each made contiguous.
+  if (count > 1)
+    fat32_reserve(count * ((size + 512L * sectors_per_cluster - 1) / (512L * sectors_per_cluster)));
+
+  batch_frames = 0;
+  batch_frame = PEEK(0xD7FAU); // frame counter
+  for (made = 0; made < count; made++) {
+    filename_len = base_len;
+    if (count > 1) {
+      write_text(11, 10, 14, batch_text);
+      filename[filename_len++] = '0' + (made + 1) / 10;
+      filename[filename_len++] = '0' + (made + 1) % 10;
+      filename[filename_len] = 0;
+      write_text(26, 10, 14, (unsigned char*)&filename[base_len]);
+    }
+    filename[filename_len] = 0;
+
+    // Copy filename into diskname before it gets extended by the filename extension
+    strcpy(diskname, filename);
 
-  // Actually create the file
-  //  while(!PEEK(0xD610)) POKE(0xD020,PEEK(0xD020)+1); POKE(0xD610,0);
-  file_sector = fat32_create_contiguous_file(
-      filename, isD65 ? (85 * 64 * 2 * 512L) : (80 * 10 * 2 * 512L), root_dir_sector, fat1_sector, fat2_sector);
-  if (!file_sector) {
+    filename[filename_len++] = '.';
+    filename[filename_len++] = 0x44;
+    if (isD65) {
+      filename[filename_len++] = 0x36;
+      filename[filename_len++] = 0x35;
+    }
+    else {
+      filename[filename_len++] = 0x38;
+      filename[filename_len++] = 0x31;
+    }
+    filename[filename_len] = 0;
+    lcopy((long)filename, 0x0400, 16);
+
+    // Actually create the file
+    //  while(!PEEK(0xD610)) POKE(0xD020,PEEK(0xD020)+1); POKE(0xD610,0);
+    // (in the current directory, so that the image can be mounted from there)
+    file_sector = fat32_create_contiguous_file(filename, size, fat32_current_dir_cluster());
+    count_frames();
+    if (!file_sector)
+      break;
+
+    // Write header, BAM and zero out directory track
+    write_text(11, 11, 14, formatting_text);
+    format_disk_image(file_sector, diskname, isD65);
+    if (!made)
+      strcpy(mount_name, filename);
+  }
+  fat32_release();
+
+  if (made < count) {
     // Error making file
     draw_box(10, 8, 30, 14, 2, 1);
-    write_text(11, 9, 2, "Error creating file");
-    write_text(11, 12, 1, "Press almost any key...");
+    write_text(11, 9, 2, create_error_text);
+    if (made) {
+      decimal_text(number, made);
+      write_text(11, 10, 2, (unsigned char*)number);
+      write_text(14, 10, 2, batch_created_text);
+    }
+    write_text(11, 12, 1, press_key_text);
     while (!PEEK(0xD610))
       continue;
     POKE(0xD610, 0);
   }
-  else {
+  if (made) {
     // File creation succeeded
 
-    // Write header, BAM and zero out directory track
-    write_text(11, 10, 14, "FORMATTING IMAGE...");
-    format_disk_image(file_sector, diskname, isD65);
-
     draw_box(8, 8, 32, 14, 13, 1);
-    write_text(9, 9, 13, "Created disk image");
-    write_text(9, 12, 1, "Press almost any key...");
+    write_text(9, 9, 13, created_text);
+    if (count > 1) {
+      decimal_text(number, made);
+      write_text(9, 10, 13, (unsigned char*)number);
+      write_text(12, 10, 13, batch_created_text);
+      // Overall throughput, with 50 or 60 frames a second ($D06F bit 7 = NTSC)
+      if (batch_frames) {
+        kb = (unsigned long)made * (size >> 10);
+        decimal_text(number, kb * ((PEEK(0xD06FU) & 0x80) ? 60 : 50) / batch_frames);
+        write_text(9, 11, 13, (unsigned char*)number);
+        write_text(9 + strlen(number) + 1, 11, 13, throughput_text);
+      }
+    }
+    write_text(9, 12, 1, press_key_text);
 
-    // Mark it as mounted in freeze slot stored in $03C0/1
+    // Mark (the first) one as mounted in freeze slot stored in $03C0/1
+    // (in the global slot_number, so that handoff_give() knows which slot
+    // freeze_slot_start_sector is for)
     slot_number = PEEK(0x3C0) + (PEEK(0x3C1) << 8L);
     request_freeze_region_list();
     find_freeze_slot_start_sector(slot_number);
     freeze_slot_start_sector = *(uint32_t*)0xD681U;
 
     // Replace disk image name in process descriptor block
-    for (i = 0; (i < 32) && filename[i]; i++)
-      freeze_poke(0xFFFBD00L + 0x15 + i, filename[i]);
+    for (i = 0; (i < 32) && mount_name[i]; i++)
+      freeze_poke(0xFFFBD00L + 0x15 + i, mount_name[i]);
     // Update length of name
     freeze_poke(0xFFFBD00L + 0x13, i);
     // Pad with spaces as required by hypervisor
@@ -403,12 +524,17 @@ int main(int argc, char** argv)
   POKE(0xD418U, 0);
   POKE(0xD438U, 0);
 
-  set_palette();
+  // Skip what the tool that started us has already done
+  handoff_take();
+  if (!(handoff_valid & HANDOFF_PALETTE))
+    set_palette();
 
   // Now find the start sector of the slot, and make a copy for safe keeping
   slot_number = 0;
-  find_freeze_slot_start_sector(slot_number);
-  freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  if (!(handoff_valid & HANDOFF_SLOT)) {
+    find_freeze_slot_start_sector(slot_number);
+    freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  }
 
   // SD or SDHC card?
   if (PEEK(0xD680U) & 0x10)
@@ -418,13 +544,17 @@ int main(int argc, char** argv)
 
   setup_menu_screen();
 
-  request_freeze_region_list();
+  if (!(handoff_valid & HANDOFF_SLOT))
+    request_freeze_region_list();
+  handoff_valid |= HANDOFF_PALETTE | HANDOFF_SLOT;
 
   if (PEEK(0x033C))
     do_make_disk_image(1); // 0=DD, 1=HD
   else
     do_make_disk_image(0); // 0=DD, 1=HD
-  mega65_dos_exechelper("FREEZER.M65");
+  handoff_give();
+  toolcache_exec("FREEZER.M65");
+  handoff_cancel();
 
   return;
 }
@@ -12,6 +12,8 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_toolcache.h"
+#include "freezer_handoff.h"
 
 void setup_menu_screen(void)
 {
@@ -113,7 +115,11 @@ int main(int argc, char** argv)
   POKE(0xD418U, 0);
   POKE(0xD438U, 0);
 
-  set_palette();
+  // Skip what the tool that started us has already done
+  handoff_take();
+  if (!(handoff_valid & HANDOFF_PALETTE))
+    set_palette();
+  handoff_valid |= HANDOFF_PALETTE;
 
   // SD or SDHC card?
   if (PEEK(0xD680U) & 0x10)
@@ -124,7 +130,9 @@ int main(int argc, char** argv)
   setup_menu_screen();
 
   do_megainfo();
-  mega65_dos_exechelper("FREEZER.M65");
+  handoff_give();
+  toolcache_exec("FREEZER.M65");
+  handoff_cancel();
 
   return;
 }
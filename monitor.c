@@ -12,6 +12,8 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_toolcache.h"
+#include "freezer_handoff.h"
 
 void setup_menu_screen(void)
 {
@@ -114,12 +116,17 @@ int main(int argc, char** argv)
   POKE(0xD418U, 0);
   POKE(0xD438U, 0);
 
-  set_palette();
+  // Skip what the tool that started us has already done
+  handoff_take();
+  if (!(handoff_valid & HANDOFF_PALETTE))
+    set_palette();
 
   // Now find the start sector of the slot, and make a copy for safe keeping
   slot_number = 0;
-  find_freeze_slot_start_sector(slot_number);
-  freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  if (!(handoff_valid & HANDOFF_SLOT)) {
+    find_freeze_slot_start_sector(slot_number);
+    freeze_slot_start_sector = *(uint32_t*)0xD681U;
+  }
 
   // SD or SDHC card?
   if (PEEK(0xD680U) & 0x10)
@@ -129,10 +136,16 @@ int main(int argc, char** argv)
 
   setup_menu_screen();
 
-  request_freeze_region_list();
+  if (!(handoff_valid & HANDOFF_SLOT))
+    request_freeze_region_list();
+  handoff_valid |= HANDOFF_PALETTE | HANDOFF_SLOT;
 
   freeze_monitor();
-  mega65_dos_exechelper("FREEZER.M65");
+  // Anything in the slot might have been changed, including the ROM
+  handoff_valid &= ~HANDOFF_ROM;
+  handoff_give();
+  toolcache_exec("FREEZER.M65");
+  handoff_cancel();
 
   return;
 }
@@ -12,6 +12,8 @@
 #include "fdisk_memory.h"
 #include "fdisk_screen.h"
 #include "fdisk_fat32.h"
+#include "freezer_toolcache.h"
+#include "freezer_handoff.h"
 #include "ascii.h"
 
 unsigned char colour_table[256];
@@ -83,7 +85,10 @@ int main(int argc, char** argv)
   POKE(0xD418U, 0);
   POKE(0xD438U, 0);
 
-  set_palette();
+  // Skip what the tool that started us has already done
+  handoff_take();
+  if (!(handoff_valid & HANDOFF_PALETTE))
+    set_palette();
 
   // done in freeze_sprited.c:Initialize
   // Now find the start sector of the slot, and make a copy for safe keeping
@@ -113,7 +118,11 @@ int main(int argc, char** argv)
   // 256-colour char data from chip RAM, not expansion RAM
   POKE(0xD063U, 0x00);
 
-  mega65_dos_exechelper("FREEZER.M65");
+  // The palette might have been edited
+  handoff_valid &= ~HANDOFF_PALETTE;
+  handoff_give();
+  toolcache_exec("FREEZER.M65");
+  handoff_cancel();
 
   return;
 }
@@ -0,0 +1,63 @@
+# Audio mixer screens, compiled into audiomix_tpl.h by tools/screenh
+#
+# The coefficient values, dB bars and their annotations are filled in
+# by freeze_audiomix.c before the screen is copied out.
+
+screen audio_menu
+         MEGA65 AUDIO MIXER MENU
+  (C) FLINDERS UNI, M.E.G.A. 2018-2024
+ cccccccccccccccccccccccccccccccccccccc
+        LFT RGT PH1 PH2 BTL BTR HDL HDR
+        cccccccccccccccccccccccccccccccc
+   SIDLb
+   SIDRb
+ PHONE1b
+ PHONE2b
+BTOOTHLb
+BTOOTHRb
+LINEINLb
+LINEINRb
+  DIGILb
+  DIGIRb
+  MIC0Lb
+  MIC0Rb
+  MIC1Lb
+  MIC1Rb
+ OPL FMb
+ MASTERb
+ cccccccccccccccccccccccccccccccccccccc
+ T - TEST SOUND, CURSOR KEYS - NAVIGATE
+ +/- ADJUST VALUE,    0/* - FAST ADJUST
+ F3 - SIMPLE MODE,  M - TOGGLE MIC MUTE
+end
+
+screen audio_menu_simple
+         MEGA65 AUDIO MIXER MENU
+  (C) FLINDERS UNI, M.E.G.A. 2018-2024
+ cccccccccccccccccccccccccccccccccccccc
+
+         LEFT OUTPUT CHANNEL:
+        cccccccccccccccccccccccccccccccc
+    MASTERb
+ L SID 3+4b
+ R SID 1+2b
+ LEFT DIGIb
+RIGHT DIGIb
+SFX OPL FMb
+
+        RIGHT OUTPUT CHANNEL:
+        cccccccccccccccccccccccccccccccc
+    MASTERb
+ L SID 3+4b
+ R SID 1+2b
+ LEFT DIGIb
+RIGHT DIGIb
+SFX OPL FMb
+ cccccccccccccccccccccccccccccccccccccc
+ T - TEST SOUND, CURSOR KEYS - NAVIGATE
+ +/- VOL, S - STEREO/MONO, W - SWAP L/R
+ F3 - EXIT, M - MUTE, A - ADVANCED MODE
+end
+
+# dB annotation to the right of a bar at full volume
+string zero_db_label "  0DB"
@@ -0,0 +1,11 @@
+# Disk chooser texts, compiled into diskchooser_tpl.h by tools/screenh
+
+screen diskchooser_instructions
+  SELECT DISK IMAGE, THEN PRESS RETURN
+  OR PRESS RUN/STOP TO LEAVE UNCHANGED
+end
+
+# Replaces the end of the instructions if the current image can't be read
+string diskchooser_unmount "UNMOUNT CURRENT  "
+
+string reading_disk_list_message SCANNING DIRECTORY ...
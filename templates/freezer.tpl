@@ -0,0 +1,76 @@
+# Freeze menu screens, compiled into freezer_tpl.h by tools/screenh
+#
+# Column and row positions of the fields that freezer.c fills in are
+# defined next to draw_freeze_menu(), so keep them in step with this.
+# The ~ area is where the thumbnail and its surround get drawn.
+
+screen freeze_menu
+        MEGA65 FREEZE MENU V0.3.0
+  (C) MUSEUM OF ELECTRONIC GAMES & ART
+cccccccccccccccccccccccccccccccccccccccc
+F3-RESUME    F5-RESET      HELP-MEGAINFO
+cccccccccccccccccccccccccccccccccccccccc
+ (C)PU MODE:   4510  (J)OY SWAP:    YES
+ CPU (F)REQ: 40 MHZ  CAR(T) ENABLE: YES
+ C(R)T EMU:     OFF  (V)IDEO:    NTSC60
+cccccccccccccccccccccccccccccccccccccccc
+ M - MONITOR         L - LOAD ROM/CHAR
+ A - AUDIO & VOLUME
+ S - SPRITE EDITOR   HELP - MEGAINFO
+cccccccccccccccccccccccccccccccccccccccc
+~~~~~~~~~~~~~~~~~~~~
+~~~~~~~~~~~~~~~~~~~~
+~~~~~~~~~~~~~~~~~~~~ ROM:
+~~~~~~~~~~~~~~~~~~~~ TASK ID:
+~~~~~~~~~~~~~~~~~~~~ FREEZE SLOT:
+~~~~~~~~~~~~~~~~~~~~
+~~~~~~~~~~~~~~~~~~~~ (0) INTERNAL DRIVE:
+~~~~~~~~~~~~~~~~~~~~     (8) UNIT #
+~~~~~~~~~~~~~~~~~~~~
+~~~~~~~~~~~~~~~~~~~~ (1) EXTERNAL 1565:
+~~~~~~~~~~~~~~~~~~~~     (9) UNIT #
+~~~~~~~~~~~~~~~~~~~~
+end
+
+# Everything white, except the ROM version, and the disk image names,
+# which are a different colour to avoid confusion. '.' = default colour
+colour freeze_menu_colour 1
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+.
+..........................ffffffffffffff
+.
+.
+.
+.
+.
+....................eeeeeeeeeeeeeeeeeeee
+.
+.
+....................eeeeeeeeeeeeeeeeeeee
+end
+
+# Alternative top bar, without and with a freeze slot selected
+screen freeze_menu_bar
+F3-RESUME    F5-RESET      HELP-MEGAINFO
+F3-LOAD SLOT F7-SAVE SLOT  HELP-MEGAINFO
+end
+
+# Replaces the tools menu when a tool is started from a sub-directory
+screen freeze_root_warn
+ NEED TO CHANGE CURRENT DIR TO ROOT TO
+ START TOOL! THIS WILL BREAK DISK IMAGE
+ MOUNTS FROM SUBDIRS!    PROCEED (Y/N)?
+end
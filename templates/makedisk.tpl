@@ -0,0 +1,15 @@
+# MAKEDISK texts, compiled into makedisk_tpl.h by tools/screenh
+
+string no_sdcard_text COULD NOT FIND SD CARD
+string enter_name_text ENTER NAME FOR
+string hd_image_text HD (D65) IMAGE:
+string dd_image_text DD (D81) IMAGE:
+string creating_text CREATING IMAGE...
+string create_error_text ERROR CREATING FILE
+string press_key_text PRESS ALMOST ANY KEY...
+string formatting_text FORMATTING IMAGE...
+string created_text CREATED DISK IMAGE
+string count_text HOW MANY IMAGES:
+string batch_text CREATING IMAGE
+string batch_created_text IMAGES CREATED
+string throughput_text KB/SEC
@@ -0,0 +1,235 @@
+/*
+  Compile screen templates into C headers, so that the tools can DMA them
+  straight onto the screen, instead of converting ASCII to screen codes one
+  character at a time at run time.
+
+  usage: screenh <template.tpl> <output.h>
+
+  Template files are line based:
+
+    # comment
+    screen <name>         rows of up to 40 chars follow, up to a line "end"
+    colour <name> <hex>   rows of up to 40 hex digits follow, up to a line
+                          "end". Missing cells and '.' use the default <hex>
+    string <name> <text>  a single line of text, zero terminated. Put it in
+                          double quotes to keep leading or trailing spaces
+
+  For screens and strings, A-Z become screen codes $01-$1A, a-z become the
+  graphics characters $41-$5A (so 'c' is a horizontal line and 'b' a vertical
+  one), and '~' (used to mark areas drawn by other code) becomes a space.
+
+  Screens and colours are emitted as one byte per character cell. They are
+  put onto the 16-bit screen with a DMA that writes every second byte.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define COLUMNS 40
+#define MAX_ROWS 25
+
+FILE* in;
+FILE* out;
+char line[1024];
+int line_number = 0;
+const char* infile;
+
+void fail(const char* msg)
+{
+  fprintf(stderr, "%s:%d: %s\n", infile, line_number, msg);
+  exit(-1);
+}
+
+int next_line(void)
+{
+  int len;
+
+  if (!fgets(line, sizeof(line), in))
+    return 0;
+  line_number++;
+  len = strlen(line);
+  while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    line[--len] = 0;
+  return 1;
+}
+
+unsigned char to_screen(unsigned char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 0x40;
+  if (c >= 'a' && c <= 'z')
+    return c - 0x20;
+  if (c == '@')
+    return 0x00;
+  if (c == '~')
+    return 0x20;
+  return c;
+}
+
+void emit_bytes(const char* name, unsigned char* data, int count)
+{
+  int i;
+
+  fprintf(out, "unsigned char %s[%d] = {", name, count);
+  for (i = 0; i < count; i++) {
+    fprintf(out, (i % 16) ? " " : "\n  ");
+    fprintf(out, "0x%02x%s", data[i], (i < count - 1) ? "," : "");
+  }
+  fprintf(out, "\n};\n\n");
+}
+
+void emit_define(const char* name, const char* suffix, int value)
+{
+  fprintf(out, "#define ");
+  for (; *name; name++)
+    fputc(toupper(*name), out);
+  fprintf(out, "%s %d\n", suffix, value);
+}
+
+void do_screen(const char* name)
+{
+  unsigned char data[MAX_ROWS * COLUMNS];
+  int rows = 0, i, len;
+
+  while (next_line() && strcmp(line, "end")) {
+    if (rows == MAX_ROWS)
+      fail("too many rows in screen");
+    len = strlen(line);
+    if (len > COLUMNS)
+      fail("screen row is longer than 40 characters");
+    for (i = 0; i < COLUMNS; i++)
+      data[rows * COLUMNS + i] = to_screen(i < len ? line[i] : ' ');
+    rows++;
+  }
+  if (strcmp(line, "end"))
+    fail("screen is missing its \"end\" line");
+
+  emit_define(name, "_ROWS", rows);
+  emit_bytes(name, data, rows * COLUMNS);
+}
+
+int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  fail("bad colour value");
+  return 0;
+}
+
+void do_colour(const char* name, const char* def)
+{
+  unsigned char data[MAX_ROWS * COLUMNS];
+  int rows = 0, i, len, default_colour;
+
+  if (!*def)
+    fail("colour needs a default value");
+  default_colour = hex_value(*def);
+
+  while (next_line() && strcmp(line, "end")) {
+    if (rows == MAX_ROWS)
+      fail("too many rows in colour");
+    len = strlen(line);
+    if (len > COLUMNS)
+      fail("colour row is longer than 40 characters");
+    for (i = 0; i < COLUMNS; i++)
+      data[rows * COLUMNS + i] = (i < len && line[i] != '.') ? hex_value(line[i]) : default_colour;
+    rows++;
+  }
+  if (strcmp(line, "end"))
+    fail("colour is missing its \"end\" line");
+
+  emit_define(name, "_ROWS", rows);
+  emit_bytes(name, data, rows * COLUMNS);
+}
+
+void do_string(const char* name, const char* text)
+{
+  unsigned char data[COLUMNS + 1];
+  int len, i;
+
+  len = strlen(text);
+  if (len >= 2 && text[0] == '"' && text[len - 1] == '"') {
+    text++;
+    len -= 2;
+  }
+  if (len > COLUMNS)
+    fail("string is longer than 40 characters");
+  for (i = 0; i < len; i++)
+    data[i] = to_screen(text[i]);
+  data[len] = 0;
+
+  emit_define(name, "_LEN", len);
+  emit_bytes(name, data, len + 1);
+}
+
+int main(int argc, char** argv)
+{
+  char guard[256], name[256], rest[1024];
+  char *keyword, *p, *q;
+  int i;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <template.tpl> <output.h>\n", argv[0]);
+    exit(-1);
+  }
+
+  infile = argv[1];
+  in = fopen(argv[1], "r");
+  if (!in) {
+    perror(argv[1]);
+    exit(-1);
+  }
+  out = fopen(argv[2], "wt");
+  if (!out) {
+    perror(argv[2]);
+    exit(-1);
+  }
+
+  // Include guard from the output file name, e.g., freezer_tpl.h -> __FREEZER_TPL_H__
+  p = strrchr(argv[2], '/');
+  p = p ? p + 1 : argv[2];
+  for (i = 0; p[i] && i < (int)sizeof(guard) - 1; i++)
+    guard[i] = isalnum(p[i]) ? toupper(p[i]) : '_';
+  guard[i] = 0;
+
+  fprintf(out, "/* Generated by tools/screenh from %s -- do not edit */\n", argv[1]);
+  fprintf(out, "#ifndef __%s__\n#define __%s__\n\n", guard, guard);
+
+  while (next_line()) {
+    if (!line[0] || line[0] == '#')
+      continue;
+
+    // Split into keyword, name and the rest of the line, and take copies,
+    // as the line buffer gets reused while reading the body
+    keyword = line;
+    p = strchr(keyword, ' ');
+    if (!p)
+      fail("expected a name");
+    *p++ = 0;
+    q = strchr(p, ' ');
+    if (q)
+      *q++ = 0;
+    strcpy(name, p);
+    strcpy(rest, q ? q : "");
+
+    if (!strcmp(keyword, "screen"))
+      do_screen(name);
+    else if (!strcmp(keyword, "colour"))
+      do_colour(name, rest);
+    else if (!strcmp(keyword, "string"))
+      do_string(name, rest);
+    else
+      fail("unknown keyword");
+  }
+
+  fprintf(out, "#endif /* __%s__ */\n", guard);
+  fclose(out);
+  fclose(in);
+  return 0;
+}